@@ -23,6 +23,22 @@ int get_value_from_cli(int *val)
 	return SUCCESS;
 }
 
+/* Parse a strictly positive option value, @what names it in the error */
+int init_positive_value(int *val, const char *what)
+{
+	int v, ret;
+
+	ret = get_value_from_cli(&v);
+	if (ret || v <= 0) {
+		pr_err("Invalid %s.\n", what);
+		return ERROR;
+	}
+
+	*val = v;
+
+	return SUCCESS;
+}
+
 int get_ull_from_cli(unsigned long long *val)
 {
 	char *end;
@@ -38,6 +38,7 @@ struct ufs_characteristics {
 
 int get_ull_from_cli(unsigned long long *val);
 int get_value_from_cli(int *val);
+int init_positive_value(int *val, const char *what);
 int init_device_path(char *path);
 int characteristics_look_up(struct ufs_characteristics *c, __u32 id);
 void dump_hex(__u8 *buf, __u16 len);
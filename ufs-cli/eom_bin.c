@@ -0,0 +1,319 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "eom_bin.h"
+#include "uic.h"
+
+/*
+ * Binary EOM reports hold the same data as the text .eom reports, but as one
+ * fixed size header followed by dense per-lane grids. Every point is a fixed
+ * 4 byte cell at a position computed from its lane, timing and voltage, so a
+ * reader maps the file and indexes it directly instead of parsing lines, and
+ * points missing from the report cost no more than a zero cell.
+ */
+
+static size_t eom_bin_size(struct eom_bin_hdr *hdr)
+{
+	return sizeof(struct eom_bin_hdr) +
+	       (size_t)hdr->nr_lanes * eom_bin_nr_timing(hdr) * eom_bin_nr_voltage(hdr) * sizeof(struct eom_bin_point);
+}
+
+static int eom_bin_map(struct eom_bin *bin, int prot, size_t hdr_size)
+{
+	bin->hdr = mmap(NULL, bin->size, prot, MAP_SHARED, bin->fd, 0);
+	if (bin->hdr == MAP_FAILED) {
+		pr_err("Failed to map binary EOM report (%d)\n", errno);
+		bin->hdr = NULL;
+		return ERROR;
+	}
+
+	bin->points = (struct eom_bin_point *)((char *)bin->hdr + hdr_size);
+
+	return SUCCESS;
+}
+
+/*
+ * Create a binary report sized for the lanes and ranges of @hdr, with all
+ * points zeroed (i.e. not in the report). The caller fills the points in
+ * through the writable mapping and commits them with eom_bin_close().
+ */
+int eom_bin_create(struct eom_bin *bin, const char *path, struct eom_bin_hdr *hdr)
+{
+	if (!hdr->nr_lanes || hdr->timing_left > hdr->timing_right || hdr->voltage_low > hdr->voltage_high)
+		return ERROR;
+
+	bin->size = eom_bin_size(hdr);
+	bin->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (bin->fd < 0) {
+		pr_err("Failed to create binary EOM report %s (%d)\n", path, errno);
+		return ERROR;
+	}
+
+	if (ftruncate(bin->fd, bin->size)) {
+		pr_err("Failed to size binary EOM report %s (%d)\n", path, errno);
+		goto err;
+	}
+
+	hdr->magic = htole32(EOM_BIN_MAGIC);
+	hdr->version = htole16(EOM_BIN_VERSION);
+	hdr->hdr_size = htole16(sizeof(struct eom_bin_hdr));
+	hdr->timing_max_steps = htole16(hdr->timing_max_steps);
+	hdr->timing_max_offset = htole16(hdr->timing_max_offset);
+	hdr->voltage_max_steps = htole16(hdr->voltage_max_steps);
+	hdr->voltage_max_offset = htole16(hdr->voltage_max_offset);
+
+	if (eom_bin_map(bin, PROT_READ | PROT_WRITE, sizeof(struct eom_bin_hdr)))
+		goto err;
+
+	memcpy(bin->hdr, hdr, sizeof(*hdr));
+
+	return SUCCESS;
+
+err:
+	close(bin->fd);
+	unlink(path);
+	return ERROR;
+}
+
+int eom_bin_open(struct eom_bin *bin, const char *path)
+{
+	struct eom_bin_hdr hdr;
+	struct stat st;
+
+	bin->fd = open(path, O_RDONLY);
+	if (bin->fd < 0) {
+		pr_err("Failed to open binary EOM report %s (%d)\n", path, errno);
+		return ERROR;
+	}
+
+	if (fstat(bin->fd, &st) || st.st_size < sizeof(hdr) || pread(bin->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		pr_err("Failed to read binary EOM report %s\n", path);
+		goto err;
+	}
+
+	if (le32toh(hdr.magic) != EOM_BIN_MAGIC || le16toh(hdr.version) != EOM_BIN_VERSION) {
+		pr_err("%s is not a version %d binary EOM report\n", path, EOM_BIN_VERSION);
+		goto err;
+	}
+
+	bin->size = eom_bin_size(&hdr) - sizeof(hdr) + le16toh(hdr.hdr_size);
+	if (le16toh(hdr.hdr_size) < sizeof(hdr) || !hdr.nr_lanes || hdr.timing_left > hdr.timing_right ||
+	    hdr.voltage_low > hdr.voltage_high || st.st_size != bin->size) {
+		pr_err("Binary EOM report %s is corrupted\n", path);
+		goto err;
+	}
+
+	if (eom_bin_map(bin, PROT_READ, le16toh(hdr.hdr_size)))
+		goto err;
+
+	return SUCCESS;
+
+err:
+	close(bin->fd);
+	return ERROR;
+}
+
+int eom_bin_close(struct eom_bin *bin)
+{
+	int ret = SUCCESS;
+
+	if (msync(bin->hdr, bin->size, MS_SYNC)) {
+		pr_err("Failed to write binary EOM report (%d)\n", errno);
+		ret = ERROR;
+	}
+	munmap(bin->hdr, bin->size);
+	close(bin->fd);
+
+	return ret;
+}
+
+/* Parse a point line of a text report, including its optional target test count and tag */
+static bool eom_bin_parse_point(const char *line, int *l, int *t, int *v, int *e, int *target, int *flags)
+{
+	const char *p;
+
+	if (sscanf(line, "lane: %d timing: %d voltage: %d error count: %d", l, t, v, e) != 4)
+		return false;
+
+	p = strstr(line, "target:");
+	if (!p || sscanf(p, "target: %d", target) != 1)
+		*target = 0;
+
+	if (strstr(line, " inferred"))
+		*flags = EOM_BIN_INFERRED;
+	else if (strstr(line, " carried"))
+		*flags = EOM_BIN_CARRIED;
+	else
+		*flags = EOM_BIN_MEASURED;
+
+	return true;
+}
+
+/*
+ * Convert a text report to a binary one. The grids cover the lanes and ranges
+ * of the points in the report. Tested counts are not in text reports and are
+ * left 0, and Bathtub sections are dropped.
+ */
+int eom_bin_from_text(const char *text_path, const char *bin_path)
+{
+	int l, t, v, e, target, flags, gear, steps, offset, n = 0, ret = ERROR;
+	int first_lane = INT_MAX, last_lane = INT_MIN, tl = INT_MAX, tr = INT_MIN, vl = INT_MAX, vh = INT_MIN;
+	struct eom_bin_point *pt;
+	struct eom_bin_hdr hdr;
+	struct eom_bin bin;
+	char line[256], side[16], rate;
+	const char *p;
+	FILE *file;
+
+	memset(&hdr, 0, sizeof(hdr));
+
+	file = fopen(text_path, "r");
+	if (!file) {
+		pr_err("Failed to open EOM report %s\n", text_path);
+		return ERROR;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		if (sscanf(line, "UFS %15s Side Eye Monitor Start", side) == 1) {
+			hdr.side = !strcmp(side, "Device");
+		} else if (sscanf(line, "- - - - UFS INQUIRY ID: %15s %31s %15s", hdr.manufacturer, hdr.product,
+				  hdr.revision) >= 1) {
+			continue;
+		} else if (sscanf(line, "- - - - UFS Gear Speed: HS-G%d Rate-%c", &gear, &rate) == 2) {
+			hdr.gear = gear;
+			hdr.rate = rate == 'A' ? PA_HS_MODE_A : PA_HS_MODE_B;
+		} else if (sscanf(line, "TimingMaxSteps %d TimingMaxOffset %d", &steps, &offset) == 2) {
+			hdr.timing_max_steps = steps;
+			hdr.timing_max_offset = offset;
+		} else if (sscanf(line, "VoltageMaxSteps %d VoltageMaxOffset %d", &steps, &offset) == 2) {
+			hdr.voltage_max_steps = steps;
+			hdr.voltage_max_offset = offset;
+		} else if (eom_bin_parse_point(line, &l, &t, &v, &e, &target, &flags)) {
+			if (l < 0 || l > UCHAR_MAX || t < SCHAR_MIN || t > SCHAR_MAX || v < SCHAR_MIN || v > SCHAR_MAX)
+				continue;
+
+			first_lane = l < first_lane ? l : first_lane;
+			last_lane = l > last_lane ? l : last_lane;
+			tl = t < tl ? t : tl;
+			tr = t > tr ? t : tr;
+			vl = v < vl ? v : vl;
+			vh = v > vh ? v : vh;
+			if (target) {
+				hdr.flags |= EOM_BIN_PER_POINT_TARGET;
+				hdr.target_cnt = target > hdr.target_cnt ? target : hdr.target_cnt;
+			}
+			n++;
+		}
+	}
+
+	if (!n) {
+		pr_err("No point in EOM report %s\n", text_path);
+		goto out;
+	}
+
+	/* Without per-point target test counts, the scan's one is in the report name */
+	p = strstr(text_path, "_ttc_");
+	if (!hdr.target_cnt && p)
+		hdr.target_cnt = atoi(p + strlen("_ttc_"));
+
+	hdr.first_lane = first_lane;
+	hdr.nr_lanes = last_lane - first_lane + 1;
+	hdr.timing_left = tl;
+	hdr.timing_right = tr;
+	hdr.voltage_low = vl;
+	hdr.voltage_high = vh;
+
+	if (eom_bin_create(&bin, bin_path, &hdr))
+		goto out;
+
+	rewind(file);
+	while (fgets(line, sizeof(line), file)) {
+		if (!eom_bin_parse_point(line, &l, &t, &v, &e, &target, &flags) ||
+		    l < first_lane || l > last_lane || t < tl || t > tr || v < vl || v > vh)
+			continue;
+
+		/* A point listed again was re-measured, the last line wins */
+		pt = eom_bin_point_at(&bin, l, t, v);
+		pt->error_cnt = e > UCHAR_MAX ? UCHAR_MAX : e;
+		pt->target_cnt = target || flags != EOM_BIN_MEASURED ? target : hdr.target_cnt;
+		pt->flags = flags;
+	}
+
+	ret = eom_bin_close(&bin);
+	if (!ret)
+		printf("Converted %d points of %s to %s\n", n, text_path, bin_path);
+out:
+	fclose(file);
+	return ret;
+}
+
+/* Convert a binary report to a text one that ufs-eom-plot.py reads */
+int eom_bin_to_text(const char *bin_path, const char *text_path)
+{
+	struct eom_bin_point *pt;
+	struct eom_bin_hdr *hdr;
+	struct eom_bin bin;
+	int l, t, v, n = 0, ret;
+	FILE *file;
+
+	ret = eom_bin_open(&bin, bin_path);
+	if (ret)
+		return ret;
+	hdr = bin.hdr;
+
+	file = fopen(text_path, "w");
+	if (!file) {
+		pr_err("Failed to create EOM report %s\n", text_path);
+		eom_bin_close(&bin);
+		return ERROR;
+	}
+
+	fprintf(file, "UFS %s Side Eye Monitor Start\n", hdr->side ? "Device" : "Host");
+	fprintf(file, "- - - - UFS INQUIRY ID: %.16s %.32s %.16s\n", hdr->manufacturer, hdr->product, hdr->revision);
+	fprintf(file, "- - - - UFS Gear Speed: HS-G%d Rate-%c\n", hdr->gear, hdr->rate == PA_HS_MODE_A ? 'A' : 'B');
+	fprintf(file, "EOM Capabilities:\n");
+	fprintf(file, "TimingMaxSteps %d TimingMaxOffset %d\n", le16toh(hdr->timing_max_steps),
+		le16toh(hdr->timing_max_offset));
+	fprintf(file, "VoltageMaxSteps %d VoltageMaxOffset %d\n\n", le16toh(hdr->voltage_max_steps),
+		le16toh(hdr->voltage_max_offset));
+
+	for (l = hdr->first_lane; l < hdr->first_lane + hdr->nr_lanes; l++) {
+		for (t = hdr->timing_left; t <= hdr->timing_right; t++) {
+			for (v = hdr->voltage_low; v <= hdr->voltage_high; v++) {
+				pt = eom_bin_point_at(&bin, l, t, v);
+				if (!pt->flags)
+					continue;
+
+				fprintf(file, "lane: %d timing: %d voltage: %d error count: %d", l, t, v, pt->error_cnt);
+				if ((hdr->flags & EOM_BIN_PER_POINT_TARGET) && pt->target_cnt)
+					fprintf(file, " target: %d", pt->target_cnt);
+				fprintf(file, "%s\n", pt->flags & EOM_BIN_INFERRED ? " inferred" :
+						      pt->flags & EOM_BIN_CARRIED ? " carried" : "");
+				n++;
+			}
+		}
+	}
+
+	if (fclose(file)) {
+		pr_err("Failed to write EOM report %s\n", text_path);
+		ret = ERROR;
+	} else {
+		printf("Converted %d points of %s to %s\n", n, bin_path, text_path);
+	}
+
+	eom_bin_close(&bin);
+
+	return ret;
+}
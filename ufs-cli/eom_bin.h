@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#ifndef __EOM_BIN_H__
+#define __EOM_BIN_H__
+
+#include <linux/types.h>
+#include <sys/types.h>
+#include <stddef.h>
+#include "common.h"
+
+#define EOM_BIN_MAGIC			0x45534655	/* "UFSE" in file order */
+#define EOM_BIN_VERSION			1
+#define EOM_BIN_SUFFIX			".eomb"
+
+/* Header flags */
+#define EOM_BIN_PER_POINT_TARGET	0x1	/* Target test count varies per point */
+
+/* Point flags, same as the text report tags */
+#define EOM_BIN_MEASURED		0x1
+#define EOM_BIN_INFERRED		0x2
+#define EOM_BIN_CARRIED			0x4
+
+/**
+ * struct eom_bin_hdr - Binary EOM report header
+ * @magic: EOM_BIN_MAGIC
+ * @version: EOM_BIN_VERSION, bumped on any incompatible layout change
+ * @hdr_size: Offset of the point grid, readers must skip to it
+ * @side: 0 for the Host (local) Rx, 1 for the Device (peer) Rx
+ * @gear: HS gear the eye was taken at
+ * @rate: PA_HS_MODE_A or PA_HS_MODE_B
+ * @flags: EOM_BIN_PER_POINT_TARGET
+ * @first_lane: Lane of the first grid
+ * @nr_lanes: Number of grids
+ * @target_cnt: Target test count of the scan
+ * @timing_left: First timing step of the grids
+ * @timing_right: Last timing step of the grids
+ * @voltage_low: First voltage step of the grids
+ * @voltage_high: Last voltage step of the grids
+ * @timing_max_steps: RX_EYEMON_Timing_MAX_Steps_Capability
+ * @timing_max_offset: RX_EYEMON_Timing_MAX_Offset_Capability
+ * @voltage_max_steps: RX_EYEMON_Voltage_MAX_Steps_Capability
+ * @voltage_max_offset: RX_EYEMON_Voltage_MAX_Offset_Capability
+ * @manufacturer: Manufacturer Name, NUL padded
+ * @product: Product Name, NUL padded
+ * @revision: Product Revision Level, NUL padded
+ *
+ * All fields are little endian. The header is followed by @nr_lanes grids of
+ * (@timing_right - @timing_left + 1) x (@voltage_high - @voltage_low + 1)
+ * points, timing major, so that the whole file can be mmap()ed and indexed
+ * with eom_bin_point_at().
+ */
+struct eom_bin_hdr {
+	__u32 magic;
+	__u16 version;
+	__u16 hdr_size;
+	__u8 side;
+	__u8 gear;
+	__u8 rate;
+	__u8 flags;
+	__u8 first_lane;
+	__u8 nr_lanes;
+	__u8 target_cnt;
+	__u8 reserved0;
+	__s8 timing_left;
+	__s8 timing_right;
+	__s8 voltage_low;
+	__s8 voltage_high;
+	__u16 timing_max_steps;
+	__u16 timing_max_offset;
+	__u16 voltage_max_steps;
+	__u16 voltage_max_offset;
+	__u32 reserved1;
+	char manufacturer[16];
+	char product[32];
+	char revision[16];
+	__u8 reserved2[32];
+};
+
+/**
+ * struct eom_bin_point - One point of a lane grid
+ * @error_cnt: RX_EYEMON_Error_Count
+ * @tested_cnt: RX_EYEMON_Tested_Count, 0 if unknown (e.g. converted from text)
+ * @target_cnt: Target test count the point was measured with, 0 if it was not measured
+ * @flags: EOM_BIN_MEASURED, EOM_BIN_INFERRED or EOM_BIN_CARRIED, 0 if the point is not in the report
+ */
+struct eom_bin_point {
+	__u8 error_cnt;
+	__u8 tested_cnt;
+	__u8 target_cnt;
+	__u8 flags;
+};
+
+struct eom_bin {
+	int fd;
+	size_t size;
+	struct eom_bin_hdr *hdr;
+	struct eom_bin_point *points;
+};
+
+static inline int eom_bin_nr_timing(struct eom_bin_hdr *hdr)
+{
+	return hdr->timing_right - hdr->timing_left + 1;
+}
+
+static inline int eom_bin_nr_voltage(struct eom_bin_hdr *hdr)
+{
+	return hdr->voltage_high - hdr->voltage_low + 1;
+}
+
+static inline struct eom_bin_point *eom_bin_point_at(struct eom_bin *bin, int lane, int timing, int volt)
+{
+	struct eom_bin_hdr *hdr = bin->hdr;
+
+	return &bin->points[((lane - hdr->first_lane) * eom_bin_nr_timing(hdr) + (timing - hdr->timing_left)) *
+			    eom_bin_nr_voltage(hdr) + (volt - hdr->voltage_low)];
+}
+
+int eom_bin_create(struct eom_bin *bin, const char *path, struct eom_bin_hdr *hdr);
+int eom_bin_open(struct eom_bin *bin, const char *path);
+int eom_bin_close(struct eom_bin *bin);
+int eom_bin_from_text(const char *text_path, const char *bin_path);
+int eom_bin_to_text(const char *bin_path, const char *text_path);
+#endif /* __EOM_BIN_H__ */
@@ -0,0 +1,268 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#include <malloc.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "eom_pattern.h"
+
+/*
+ * Data patterns for the -D link stress of ufseom. They are generated once
+ * into a pool of buffers which the stress I/O writes from as is, so that the
+ * CPU is not busy while the Eye Monitor runs. Every implementation produces
+ * the same bytes for the same seed, so a pattern is the same on every device.
+ *
+ * Note that what reaches the wire also depends on the M-PHY line coding
+ * (8b/10b up to HS-G4, scrambled 128b/129b at HS-G5).
+ */
+
+#define EOM_PATTERN_ALIGN		4096
+/* Independent xorshift64 generators of the random pattern, one per 64-bit lane of a 256-bit vector */
+#define EOM_PATTERN_LANES		4
+
+static const char *eom_pattern_names[EOM_PATTERN_MAX] = {
+	"random",
+	"prbs7",
+	"prbs15",
+	"prbs31",
+	"cjtpat",
+	"alt",
+	"low",
+};
+
+/*
+ * CJTPAT-like block: long runs (six ones, then six zeros) alternating with
+ * bursts of maximum transition density, i.e. the low to high frequency
+ * content of CJTPAT without its 8b/10b specific code groups.
+ */
+static const unsigned char eom_pattern_cjtpat[] = {
+	0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E, 0x7E,
+	0xAA, 0xAA, 0xAA, 0xAA,
+	0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81,
+	0x55, 0x55, 0x55, 0x55,
+};
+
+/* Every bit toggles */
+static const unsigned char eom_pattern_alt[] = { 0xAA };
+
+/* Runs of 32 zeros and 32 ones */
+static const unsigned char eom_pattern_low[] = { 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF };
+
+const char *eom_pattern_name(int pattern)
+{
+	if (pattern == EOM_PATTERN_ROTATE)
+		return "rotate";
+
+	return eom_pattern_names[pattern];
+}
+
+/* Pattern by name, EOM_PATTERN_ROTATE for "rotate", ERROR if unknown */
+int eom_pattern_parse(const char *name)
+{
+	int i;
+
+	if (!strcmp(name, "rotate"))
+		return EOM_PATTERN_ROTATE;
+
+	for (i = 0; i < EOM_PATTERN_MAX; i++) {
+		if (!strcmp(name, eom_pattern_names[i]))
+			return i;
+	}
+
+	return ERROR;
+}
+
+/* Repeat the first @len bytes of @buf over @size bytes, doubling the copied span */
+static void eom_pattern_tile(char *buf, size_t size, size_t len)
+{
+	size_t n;
+
+	while (len < size) {
+		n = len < size - len ? len : size - len;
+		memcpy(buf + len, buf, n);
+		len += n;
+	}
+}
+
+static void eom_pattern_block(char *buf, size_t size, const unsigned char *block, size_t len)
+{
+	memcpy(buf, block, len < size ? len : size);
+	eom_pattern_tile(buf, size, len);
+}
+
+/* 8 bits of the sequence in @buf from bit @pos on, MSB first */
+static unsigned char eom_prbs_window(const char *buf, size_t pos)
+{
+	const unsigned char *p = (const unsigned char *)buf + (pos >> 3);
+	int k = pos & 7;
+
+	return k ? (p[0] << k) | (p[1] >> (8 - k)) : p[0];
+}
+
+/*
+ * PRBS of x^order + x^tap + 1 from the all ones state, MSB first. An odd
+ * period of 2^order - 1 bits repeats every 2^order - 1 bytes, so only one
+ * period is generated and tiled. Bit n is bit (n - order) ^ bit (n - tap),
+ * so once both are at least a byte back, a whole byte is generated at once.
+ */
+static void eom_pattern_prbs(char *buf, size_t size, int order, int tap)
+{
+	uint32_t mask = (1U << order) - 1, state = mask, bit;
+	size_t i, len = mask < size ? mask : size;
+	unsigned char byte;
+	int b;
+
+	for (i = 0; i < len; i++) {
+		if (tap >= 8 && i * 8 >= (size_t)order) {
+			buf[i] = eom_prbs_window(buf, i * 8 - order) ^ eom_prbs_window(buf, i * 8 - tap);
+			continue;
+		}
+
+		byte = 0;
+		for (b = 0; b < 8; b++) {
+			bit = ((state >> (order - 1)) ^ (state >> (tap - 1))) & 1;
+			state = ((state << 1) | bit) & mask;
+			byte = (byte << 1) | bit;
+		}
+		buf[i] = byte;
+	}
+
+	eom_pattern_tile(buf, size, len);
+}
+
+static uint64_t splitmix64(uint64_t *seed)
+{
+	uint64_t z = (*seed += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+	return z ^ (z >> 31);
+}
+
+static void eom_xorshift_lanes(uint64_t *s)
+{
+	int l;
+
+	for (l = 0; l < EOM_PATTERN_LANES; l++) {
+		s[l] ^= s[l] << 13;
+		s[l] ^= s[l] >> 7;
+		s[l] ^= s[l] << 17;
+	}
+}
+
+/*
+ * Random data from EOM_PATTERN_LANES interleaved xorshift64 generators, in
+ * 256-bit vectors with AVX2 or NEON, or one lane at a time otherwise.
+ */
+static void eom_pattern_random(char *buf, size_t size, uint64_t seed)
+{
+	uint64_t s[EOM_PATTERN_LANES];
+	size_t i = 0;
+	int l;
+
+	for (l = 0; l < EOM_PATTERN_LANES; l++)
+		s[l] = splitmix64(&seed);
+
+#if defined(__AVX2__)
+	{
+		__m256i v = _mm256_loadu_si256((__m256i *)s);
+
+		for (; i + sizeof(s) <= size; i += sizeof(s)) {
+			v = _mm256_xor_si256(v, _mm256_slli_epi64(v, 13));
+			v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 7));
+			v = _mm256_xor_si256(v, _mm256_slli_epi64(v, 17));
+			_mm256_storeu_si256((__m256i *)(buf + i), v);
+		}
+		_mm256_storeu_si256((__m256i *)s, v);
+	}
+#elif defined(__ARM_NEON)
+	{
+		uint64x2_t lo = vld1q_u64(s), hi = vld1q_u64(s + 2);
+
+		for (; i + sizeof(s) <= size; i += sizeof(s)) {
+			lo = veorq_u64(lo, vshlq_n_u64(lo, 13));
+			hi = veorq_u64(hi, vshlq_n_u64(hi, 13));
+			lo = veorq_u64(lo, vshrq_n_u64(lo, 7));
+			hi = veorq_u64(hi, vshrq_n_u64(hi, 7));
+			lo = veorq_u64(lo, vshlq_n_u64(lo, 17));
+			hi = veorq_u64(hi, vshlq_n_u64(hi, 17));
+			vst1q_u64((uint64_t *)(buf + i), lo);
+			vst1q_u64((uint64_t *)(buf + i + 16), hi);
+		}
+		vst1q_u64(s, lo);
+		vst1q_u64(s + 2, hi);
+	}
+#endif
+
+	for (; i + sizeof(s) <= size; i += sizeof(s)) {
+		eom_xorshift_lanes(s);
+		memcpy(buf + i, s, sizeof(s));
+	}
+
+	if (i < size) {
+		eom_xorshift_lanes(s);
+		memcpy(buf + i, s, size - i);
+	}
+}
+
+void eom_pattern_fill(char *buf, size_t size, int pattern, uint64_t seed)
+{
+	switch (pattern) {
+	case EOM_PATTERN_RANDOM:
+		eom_pattern_random(buf, size, seed);
+		break;
+	case EOM_PATTERN_PRBS7:
+		eom_pattern_prbs(buf, size, 7, 6);
+		break;
+	case EOM_PATTERN_PRBS15:
+		eom_pattern_prbs(buf, size, 15, 14);
+		break;
+	case EOM_PATTERN_PRBS31:
+		eom_pattern_prbs(buf, size, 31, 28);
+		break;
+	case EOM_PATTERN_CJTPAT:
+		eom_pattern_block(buf, size, eom_pattern_cjtpat, sizeof(eom_pattern_cjtpat));
+		break;
+	case EOM_PATTERN_ALT:
+		eom_pattern_block(buf, size, eom_pattern_alt, sizeof(eom_pattern_alt));
+		break;
+	case EOM_PATTERN_LOW:
+		eom_pattern_block(buf, size, eom_pattern_low, sizeof(eom_pattern_low));
+		break;
+	}
+}
+
+/* Fill one buffer of @size bytes with @pattern, or one per pattern for EOM_PATTERN_ROTATE */
+int eom_pattern_pool_init(struct eom_pattern_pool *pool, int pattern, size_t size, uint64_t seed)
+{
+	int i;
+
+	pool->size = size;
+	pool->nr = pattern == EOM_PATTERN_ROTATE ? EOM_PATTERN_MAX : 1;
+	pool->buf = memalign(EOM_PATTERN_ALIGN, size * pool->nr);
+	if (!pool->buf) {
+		pr_err("Failed to allocate memory for data patterns\n");
+		return ERROR;
+	}
+
+	for (i = 0; i < pool->nr; i++) {
+		pool->patterns[i] = pattern == EOM_PATTERN_ROTATE ? i : pattern;
+		eom_pattern_fill(eom_pattern_pool_buf(pool, i), size, pool->patterns[i], seed);
+	}
+
+	return SUCCESS;
+}
+
+void eom_pattern_pool_free(struct eom_pattern_pool *pool)
+{
+	free(pool->buf);
+	pool->buf = NULL;
+	pool->nr = 0;
+}
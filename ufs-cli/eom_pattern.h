@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#ifndef __EOM_PATTERN_H__
+#define __EOM_PATTERN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+
+enum eom_pattern {
+	EOM_PATTERN_RANDOM,
+	EOM_PATTERN_PRBS7,
+	EOM_PATTERN_PRBS15,
+	EOM_PATTERN_PRBS31,
+	EOM_PATTERN_CJTPAT,
+	EOM_PATTERN_ALT,
+	EOM_PATTERN_LOW,
+	EOM_PATTERN_MAX,
+};
+
+/* Not a pattern, every pattern in turn */
+#define EOM_PATTERN_ROTATE		EOM_PATTERN_MAX
+
+/**
+ * struct eom_pattern_pool - Buffers pre-filled with data patterns, reused as is
+ * @buf: @nr buffers of @size bytes, page aligned
+ * @size: Size of each buffer
+ * @nr: Number of buffers
+ * @patterns: Pattern of each buffer
+ */
+struct eom_pattern_pool {
+	char *buf;
+	size_t size;
+	int nr;
+	int patterns[EOM_PATTERN_MAX];
+};
+
+static inline char *eom_pattern_pool_buf(struct eom_pattern_pool *pool, int i)
+{
+	return pool->buf + (size_t)i * pool->size;
+}
+
+const char *eom_pattern_name(int pattern);
+int eom_pattern_parse(const char *name);
+void eom_pattern_fill(char *buf, size_t size, int pattern, uint64_t seed);
+int eom_pattern_pool_init(struct eom_pattern_pool *pool, int pattern, size_t size, uint64_t seed);
+void eom_pattern_pool_free(struct eom_pattern_pool *pool);
+#endif /* __EOM_PATTERN_H__ */
@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "eom_trace.h"
+
+/*
+ * Block I/O traces for the -D link stress of ufseom to replay, in either of
+ * two text formats, told apart line by line:
+ *
+ * - blkparse default output, e.g.
+ *   "  8,0    3        1     0.000000000  1234  D  WS 223490 + 8 [kworker]".
+ *   The I/Os are the ones issued to the driver (D), or the queued ones (Q)
+ *   if the trace has no D event. Discards and flushes without data are
+ *   skipped.
+ * - CSV of "<offset>,<size>,<op>,<time>", with the offset and size in bytes,
+ *   the op R or W (or read or write) and the issue time in seconds. Lines that
+ *   do not parse, such as a column header, are skipped.
+ */
+
+#define EOM_TRACE_SECTOR_SIZE		512
+#define EOM_TRACE_INIT_IOS		1024
+
+struct eom_trace_line {
+	double time;
+	__u64 off;
+	__u32 len;
+	char op;
+	char action;
+};
+
+static bool eom_trace_parse_csv(const char *line, struct eom_trace_line *tl)
+{
+	unsigned long long off;
+	char op[16];
+	unsigned int len;
+
+	if (sscanf(line, " %llu , %u , %15[A-Za-z] , %lf", &off, &len, op, &tl->time) != 4 || tl->time < 0)
+		return false;
+
+	tl->off = off;
+	tl->len = len;
+	tl->op = toupper(op[0]);
+	tl->action = 0;
+
+	return true;
+}
+
+static bool eom_trace_parse_blkparse(const char *line, struct eom_trace_line *tl)
+{
+	unsigned long long sector;
+	char action[4], rwbs[16];
+	unsigned int nr_sectors;
+
+	if (sscanf(line, "%*u,%*u %*u %*u %lf %*u %3s %15s %llu + %u", &tl->time, action, rwbs, &sector,
+		   &nr_sectors) != 5)
+		return false;
+
+	/* Discards (D) carry no data over the link */
+	if (strchr(rwbs, 'D'))
+		return false;
+
+	tl->off = sector * EOM_TRACE_SECTOR_SIZE;
+	tl->len = nr_sectors * EOM_TRACE_SECTOR_SIZE;
+	tl->op = strchr(rwbs, 'W') ? 'W' : strchr(rwbs, 'R') ? 'R' : 0;
+	tl->action = action[1] ? 0 : action[0];
+
+	return true;
+}
+
+static int eom_trace_add(struct eom_trace *trace, int *size, struct eom_trace_line *tl, __u32 align,
+			 __u32 max_len)
+{
+	struct eom_trace_io *tio;
+	__u64 end;
+
+	if (trace->nr == *size) {
+		*size = *size ? *size * 2 : EOM_TRACE_INIT_IOS;
+		tio = realloc(trace->ios, *size * sizeof(*tio));
+		if (!tio) {
+			pr_err("Failed to allocate memory for the I/O trace\n");
+			return ERROR;
+		}
+		trace->ios = tio;
+	}
+
+	/* Direct I/O needs aligned I/Os, widen them to the alignment */
+	tio = &trace->ios[trace->nr++];
+	tio->time_ns = tl->time * 1e9;
+	tio->off = tl->off / align * align;
+	end = (tl->off + tl->len + align - 1) / align * align;
+	tio->len = end - tio->off > max_len ? max_len : end - tio->off;
+	tio->write = tl->op == 'W';
+
+	return SUCCESS;
+}
+
+/* Read the I/Os of @file, only the blkparse events of @action */
+static int eom_trace_read(struct eom_trace *trace, FILE *file, char action, __u32 align, __u32 max_len)
+{
+	struct eom_trace_line tl;
+	char line[512];
+	int size = 0;
+
+	while (fgets(line, sizeof(line), file)) {
+		if (!eom_trace_parse_csv(line, &tl) && !eom_trace_parse_blkparse(line, &tl))
+			continue;
+
+		if ((tl.action && tl.action != action) || !tl.len || (tl.op != 'R' && tl.op != 'W'))
+			continue;
+
+		if (eom_trace_add(trace, &size, &tl, align, max_len))
+			return ERROR;
+	}
+
+	return SUCCESS;
+}
+
+static int eom_trace_cmp(const void *a, const void *b)
+{
+	const struct eom_trace_io *x = a, *y = b;
+
+	return x->time_ns < y->time_ns ? -1 : x->time_ns > y->time_ns;
+}
+
+/*
+ * Load the I/Os of the trace at @path in issue order, with their offsets and
+ * lengths aligned to @align and lengths capped at @max_len.
+ */
+int eom_trace_load(struct eom_trace *trace, const char *path, __u32 align, __u32 max_len)
+{
+	__u64 t0, writes = 0;
+	FILE *file;
+	int i, ret;
+
+	memset(trace, 0, sizeof(*trace));
+
+	file = fopen(path, "r");
+	if (!file) {
+		pr_err("Failed to open I/O trace %s (%d)\n", path, errno);
+		return ERROR;
+	}
+
+	ret = eom_trace_read(trace, file, 'D', align, max_len);
+	if (!ret && !trace->nr) {
+		rewind(file);
+		ret = eom_trace_read(trace, file, 'Q', align, max_len);
+	}
+	fclose(file);
+	if (ret)
+		goto err;
+
+	if (!trace->nr) {
+		pr_err("No read or write in I/O trace %s\n", path);
+		goto err;
+	}
+
+	/* blkparse merges the events of all CPUs, which may be slightly out of order */
+	qsort(trace->ios, trace->nr, sizeof(*trace->ios), eom_trace_cmp);
+
+	t0 = trace->ios[0].time_ns;
+	for (i = 0; i < trace->nr; i++) {
+		trace->ios[i].time_ns -= t0;
+		if (trace->ios[i].len > trace->max_len)
+			trace->max_len = trace->ios[i].len;
+		writes += trace->ios[i].write;
+	}
+	trace->write_pct = writes * 100 / trace->nr;
+
+	return SUCCESS;
+
+err:
+	eom_trace_free(trace);
+	return ERROR;
+}
+
+void eom_trace_free(struct eom_trace *trace)
+{
+	free(trace->ios);
+	memset(trace, 0, sizeof(*trace));
+}
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#ifndef __EOM_TRACE_H__
+#define __EOM_TRACE_H__
+
+#include <linux/types.h>
+#include <stddef.h>
+#include "common.h"
+
+/**
+ * struct eom_trace_io - One I/O of a block trace
+ * @time_ns: Issue time, relative to the first I/O of the trace
+ * @off: Byte offset, aligned down to the alignment the trace was loaded with
+ * @len: Byte length, aligned up and capped at the maximum the trace was loaded with
+ * @write: Write if true, read otherwise
+ */
+struct eom_trace_io {
+	__u64 time_ns;
+	__u64 off;
+	__u32 len;
+	bool write;
+};
+
+/**
+ * struct eom_trace - Block trace to replay, in issue order
+ * @ios: I/Os of the trace
+ * @nr: Number of I/Os
+ * @max_len: Largest @len
+ * @write_pct: Percentage of writes
+ */
+struct eom_trace {
+	struct eom_trace_io *ios;
+	int nr;
+	__u32 max_len;
+	int write_pct;
+};
+
+int eom_trace_load(struct eom_trace *trace, const char *path, __u32 align, __u32 max_len);
+void eom_trace_free(struct eom_trace *trace);
+#endif /* __EOM_TRACE_H__ */
@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "eom_uring.h"
+
+/*
+ * Just enough of io_uring for the link stress engine of ufseom: one ring
+ * owned by one thread, fixed buffers and files, submit and reap. The ring
+ * indexes shared with the kernel are accessed with acquire/release ordering.
+ */
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags, void *arg,
+			  size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int io_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+int eom_uring_init(struct eom_uring *ring, unsigned int entries)
+{
+	struct io_uring_params p;
+	void *sq, *cq;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&p, 0, sizeof(p));
+
+	ring->fd = io_uring_setup(entries, &p);
+	if (ring->fd < 0) {
+		pr_err("Failed to set up io_uring (%d)\n", errno);
+		return ERROR;
+	}
+
+	ring->features = p.features;
+	ring->sq_entries = p.sq_entries;
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_size > ring->sq_ring_size)
+			ring->sq_ring_size = ring->cq_ring_size;
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	sq = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+		  IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		goto err;
+	ring->sq_ring = sq;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else {
+		cq = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+			  IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			goto err;
+	}
+	ring->cq_ring = cq;
+
+	ring->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto err;
+	}
+
+	ring->sq_head = (unsigned int *)((char *)sq + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)((char *)sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *)((char *)sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)((char *)sq + p.sq_off.array);
+	ring->sqe_tail = *ring->sq_tail;
+
+	ring->cq_head = (unsigned int *)((char *)cq + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)((char *)cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *)((char *)cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)cq + p.cq_off.cqes);
+
+	return SUCCESS;
+
+err:
+	pr_err("Failed to map io_uring (%d)\n", errno);
+	eom_uring_exit(ring);
+	return ERROR;
+}
+
+void eom_uring_exit(struct eom_uring *ring)
+{
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sq_entries * sizeof(struct io_uring_sqe));
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring)
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	if (ring->fd >= 0)
+		close(ring->fd);
+
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = INIT;
+}
+
+int eom_uring_register_buffers(struct eom_uring *ring, struct iovec *iovs, unsigned int nr_iovs)
+{
+	if (io_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iovs, nr_iovs)) {
+		pr_err("Failed to register io_uring buffers (%d)\n", errno);
+		return ERROR;
+	}
+
+	return SUCCESS;
+}
+
+int eom_uring_register_file(struct eom_uring *ring, int fd)
+{
+	if (io_uring_register(ring->fd, IORING_REGISTER_FILES, &fd, 1)) {
+		pr_err("Failed to register io_uring file (%d)\n", errno);
+		return ERROR;
+	}
+
+	return SUCCESS;
+}
+
+/* Get a zeroed SQE to fill in, NULL if the submission queue is full */
+struct io_uring_sqe *eom_uring_get_sqe(struct eom_uring *ring)
+{
+	unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	struct io_uring_sqe *sqe;
+
+	if (ring->sqe_tail - head >= ring->sq_entries)
+		return NULL;
+
+	sqe = &ring->sqes[ring->sqe_tail & *ring->sq_mask];
+	ring->sqe_tail++;
+	memset(sqe, 0, sizeof(*sqe));
+
+	return sqe;
+}
+
+/* Publish the SQEs filled in since the last call, returns how many */
+static unsigned int eom_uring_flush_sq(struct eom_uring *ring)
+{
+	unsigned int tail = *ring->sq_tail, to_submit = ring->sqe_tail - tail;
+
+	for (; tail != ring->sqe_tail; tail++)
+		ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+	__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+	return to_submit;
+}
+
+/*
+ * Submit the SQEs filled in since the last call and wait for at least
+ * @wait_nr completions. Returns the number of SQEs submitted or -errno.
+ */
+int eom_uring_submit_and_wait(struct eom_uring *ring, unsigned int wait_nr)
+{
+	unsigned int to_submit = eom_uring_flush_sq(ring);
+	int ret;
+
+	do {
+		ret = io_uring_enter(ring->fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret < 0 ? -errno : ret;
+}
+
+/*
+ * Same as eom_uring_submit_and_wait(), but stop waiting after @timeout_ns,
+ * which is not an error. Kernels without IORING_FEAT_EXT_ARG (before 5.11)
+ * sleep for @timeout_ns instead.
+ */
+int eom_uring_submit_and_wait_timeout(struct eom_uring *ring, unsigned int wait_nr, __u64 timeout_ns)
+{
+	struct __kernel_timespec ts = {
+		.tv_sec = timeout_ns / 1000000000ULL,
+		.tv_nsec = timeout_ns % 1000000000ULL,
+	};
+	struct io_uring_getevents_arg arg = {
+		.ts = (unsigned long)&ts,
+	};
+	unsigned int to_submit;
+	int ret;
+
+	if (!(ring->features & IORING_FEAT_EXT_ARG)) {
+		ret = eom_uring_submit_and_wait(ring, 0);
+		if (ret >= 0)
+			usleep(timeout_ns / 1000);
+		return ret;
+	}
+
+	to_submit = eom_uring_flush_sq(ring);
+	do {
+		ret = io_uring_enter(ring->fd, to_submit, wait_nr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+				     sizeof(arg));
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0 && errno == ETIME)
+		return 0;
+
+	return ret < 0 ? -errno : ret;
+}
+
+/* Get the oldest completion, NULL if there is none */
+struct io_uring_cqe *eom_uring_peek_cqe(struct eom_uring *ring)
+{
+	unsigned int head = *ring->cq_head;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	return &ring->cqes[head & *ring->cq_mask];
+}
+
+void eom_uring_cqe_seen(struct eom_uring *ring)
+{
+	__atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
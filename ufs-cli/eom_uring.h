@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#ifndef __EOM_URING_H__
+#define __EOM_URING_H__
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include "common.h"
+
+/**
+ * struct eom_uring - Minimal io_uring instance, driven by a single thread
+ * @fd: io_uring file descriptor
+ * @features: IORING_FEAT_* of the kernel
+ * @sq_entries: Number of submission queue entries
+ * @sq_ring: Mapped submission queue ring
+ * @sq_ring_size: Size of the @sq_ring mapping
+ * @sq_head: Consumed by the kernel
+ * @sq_tail: Produced by the application
+ * @sq_mask: Ring index mask
+ * @sq_array: Indexes of the SQEs to submit
+ * @sqes: Mapped submission queue entries
+ * @sqe_tail: SQEs handed out by eom_uring_get_sqe(), not yet submitted
+ * @cq_ring: Mapped completion queue ring, may be the same mapping as @sq_ring
+ * @cq_ring_size: Size of the @cq_ring mapping
+ * @cq_head: Consumed by the application
+ * @cq_tail: Produced by the kernel
+ * @cq_mask: Ring index mask
+ * @cqes: Completion queue entries
+ *
+ * No liburing dependency, only <linux/io_uring.h> and the raw system calls.
+ */
+struct eom_uring {
+	int fd;
+	unsigned int features;
+	unsigned int sq_entries;
+	void *sq_ring;
+	size_t sq_ring_size;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned int sqe_tail;
+	void *cq_ring;
+	size_t cq_ring_size;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+int eom_uring_init(struct eom_uring *ring, unsigned int entries);
+void eom_uring_exit(struct eom_uring *ring);
+int eom_uring_register_buffers(struct eom_uring *ring, struct iovec *iovs, unsigned int nr_iovs);
+int eom_uring_register_file(struct eom_uring *ring, int fd);
+struct io_uring_sqe *eom_uring_get_sqe(struct eom_uring *ring);
+int eom_uring_submit_and_wait(struct eom_uring *ring, unsigned int wait_nr);
+int eom_uring_submit_and_wait_timeout(struct eom_uring *ring, unsigned int wait_nr, __u64 timeout_ns);
+struct io_uring_cqe *eom_uring_peek_cqe(struct eom_uring *ring);
+void eom_uring_cqe_seen(struct eom_uring *ring);
+#endif /* __EOM_URING_H__ */
@@ -12,7 +12,8 @@ const char *lsufs_help =
 	"\nlsufs cli :\n\n"
 	"-h : help\n"
 	"uic : do uic operation, try 'lsufs uic -h'\n"
-	"query : do query operation, try 'lsufs query -h'\n";
+	"query : do query operation, try 'lsufs query -h'\n"
+	"telemetry : sample attributes into a shared memory ring or read samples from it, try 'lsufs telemetry -h'\n";
 
 const char *uic_operation_help =
 	"\nuic operation cli : \n\n"
@@ -69,11 +70,35 @@ const char *query_operation_help =
 	"  8. query toggle Flag fRefreshEnable:\n"
 	"  query -o 8 -i 0x7 -I 0 -s 0 -d /dev/ufs-bsg0\n";
 
+const char *telemetry_operation_help =
+	"\ntelemetry operation cli : \n\n"
+	"telemetry [-s | --sample | -r | --read] [-u | --uic <attrs>] [-q | --query <attrs>] [-i | --interval <ms>] [-n | --slots <slots>] [-c | --count <count>] [-f | --follow] [-m | --mem <path>] [-R | --rate <commands/s>] [-d | --device <device>]\n\n"
+	"-h | --help : help\n"
+	"-s | --sample : run the single sampler, which polls the device and publishes samples into the ring\n"
+	"-r | --read : read samples from the ring, never touches the device (default)\n"
+	"-u | --uic : UIC attributes to sample, comma separated <ID>[:tx<lane>|:rx<lane>][:local|:peer], tx0 and local by default\n"
+	"-q | --query : Query attributes to sample, comma separated <IDN>[:<index>], index 0 by default\n"
+	"-i | --interval : sampling interval in ms, %d by default\n"
+	"-n | --slots : number of samples kept in the ring, %d by default\n"
+	"-c | --count : sampler stops after <count> samples, reader dumps the latest <count> samples\n"
+	"-f | --follow : reader keeps dumping new samples until interrupted\n"
+	"-m | --mem : path to the ring file, %s by default\n"
+	"-R | --rate : limit the sampler to <commands/s> UIC and Query commands, not limited by default\n"
+	"-d | --device : path to ufs-bsg device, sampler only\n\n"
+	"Example:\n"
+	"  1. Sample local and peer PA_RxGear plus bDeviceCaseRoughTemperaure every 500 ms:\n"
+	"  telemetry -s -u 0x1583:rx0,0x1583:rx0:peer -q 0x18 -i 500 -d /dev/ufs-bsg0\n"
+	"  2. Dump the latest 10 samples:\n"
+	"  telemetry -r -c 10\n"
+	"  3. Follow new samples:\n"
+	"  telemetry -r -f\n";
+
 static struct lsufs_operation lsufs_op;
 
 static struct lsufs_operation_nt lsufs_nts[] = {
 	{"uic", OT_UIC},
 	{"query", OT_QUERY},
+	{"telemetry", OT_TELEMETRY},
 	{0, 0},
 };
 
@@ -86,6 +111,11 @@ static void print_help_info(enum lsufs_operation_type type)
 	case OT_QUERY:
 		printf("%s\n", query_operation_help);
 		break;
+	case OT_TELEMETRY:
+		printf(telemetry_operation_help, TELEMETRY_INTERVAL_DEFAULT, TELEMETRY_SLOTS_DEFAULT,
+		       TELEMETRY_RING_PATH_DEFAULT);
+		printf("\n");
+		break;
 	}
 }
 
@@ -111,6 +141,17 @@ static int kshell_op_query(struct shell_cmd_args *args)
 	return do_query_operation(&lsufs_op);
 }
 
+static int kshell_op_telemetry(struct shell_cmd_args *args)
+{
+	if (args->arg_val[0].vt_type == VT_STRING &&
+	    (!strcmp(args->arg_val[0].val.str_val, "--help") ||
+	     !strcmp(args->arg_val[0].val.str_val, "-h"))) {
+		return ERROR;
+	}
+
+	return do_telemetry_operation(&lsufs_op);
+}
+
 static int parse_args(int argc, char *argv[])
 {
 	struct lsufs_operation_nt *nt;
@@ -163,6 +204,13 @@ static int parse_args(int argc, char *argv[])
 			return ret;
 		}
 		break;
+	case OT_TELEMETRY:
+		ret = init_telemetry_operation(argc, argv, &lsufs_op);
+		if (ret) {
+			pr_err("Please try 'telemetry -h'\n");
+			return ret;
+		}
+		break;
 	}
 
 	return SUCCESS;
@@ -187,6 +235,7 @@ int main(int argc, char *argv[])
 
 	shell_add_cmd("uic", kshell_op_uic, "Please try 'uic -h'\n");
 	shell_add_cmd("query", kshell_op_query, "Please try 'query -h'\n");
+	shell_add_cmd("telemetry", kshell_op_telemetry, "Please try 'telemetry -h'\n");
 
 	if (argc >= 1)
 		return shell_process_cmd_line_args(argc, orig_argv);
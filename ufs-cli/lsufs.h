@@ -22,6 +22,7 @@
 #include "common.h"
 #include "query.h"
 #include "uic.h"
+#include "telemetry.h"
 
 struct lsufs_operation_nt {
 	char *name;
@@ -31,6 +32,7 @@ struct lsufs_operation_nt {
 enum lsufs_operation_type {
 	OT_UIC,
 	OT_QUERY,
+	OT_TELEMETRY,
 };
 
 struct lsufs_operation {
@@ -41,6 +43,7 @@ struct lsufs_operation {
 	union {
 		struct uic_operation uic_op;
 		struct query_operation query_op;
+		struct telemetry_operation telemetry_op;
 	};
 };
 #endif /* __LSUFS_H__ */
@@ -310,6 +310,33 @@ int query_read_descriptor(int fd, int idn, int index, int sel, __u8 *buf, __u16
 	return ret;
 }
 
+int query_read_attribute(int fd, int idn, int index, int sel, __u64 *val)
+{
+	struct lsufs_operation lsufs_op;
+	struct query_operation *qop = &lsufs_op.query_op;
+	struct ufs_bsg_reply bsg_reply = {0};
+	struct utp_upiu_query_attr *qr_attr;
+	__u16 buf_len = 0;
+	int ret;
+
+	lsufs_op.fd = fd;
+	qop->opcode = QUERY_REQ_OP_READ_ATTR;
+	qop->idn = idn;
+	qop->index = index;
+	qop->selector = sel;
+
+	ret = send_query_command(&lsufs_op, NULL, &buf_len, &bsg_reply);
+	if (ret) {
+		pr_err("Failed to query read Attribute IDN 0x%x, Index 0x%x.\n", idn, index);
+		return ret;
+	}
+
+	qr_attr = (struct utp_upiu_query_attr *)&bsg_reply.upiu_rsp.qr;
+	*val = be64toh(qr_attr->value);
+
+	return ret;
+}
+
 static int do_query_read_attribute(struct lsufs_operation *lsufs_op)
 {
 	struct query_operation *qop = &lsufs_op->query_op;
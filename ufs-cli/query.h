@@ -19,11 +19,29 @@
 #define PRODUCT_REVISION_LEVEL_STRING_DESC_SIZE	10
 
 #define DEVICE_DESCRIPTOR_IDN		0x0
+#define UNIT_DESCRIPTOR_IDN		0x2
 #define STRING_DESCRIPTOR_IDN		0x5
+#define GEOMETRY_DESCRIPTOR_IDN		0x7
 
 #define MANUFACTURER_NAME_OFFSET		0x14
 #define PRODUCT_NAME_OFFSET			0x15
 #define PRODUCT_REVISION_LEVEL_OFFSET		0x2A
+#define DEVICE_QUEUE_DEPTH_OFFSET		0x21
+
+/* Unit Descriptor */
+#define UNIT_LU_QUEUE_DEPTH_OFFSET		0x06
+#define UNIT_LOGICAL_BLOCK_SIZE_OFFSET		0x0A	/* 2^n bytes */
+
+/* Geometry Descriptor, sizes in 512 byte units */
+#define GEOMETRY_MIN_ADDR_BLOCK_SIZE_OFFSET	0x12
+#define GEOMETRY_OPTIMAL_READ_BLOCK_SIZE_OFFSET	0x13
+#define GEOMETRY_OPTIMAL_WRITE_BLOCK_SIZE_OFFSET	0x14
+#define GEOMETRY_MAX_IN_BUFFER_SIZE_OFFSET	0x15
+#define GEOMETRY_MAX_OUT_BUFFER_SIZE_OFFSET	0x16
+
+/* Attributes, sizes in 512 byte units */
+#define MAX_DATA_IN_SIZE_IDN			0x07
+#define MAX_DATA_OUT_SIZE_IDN			0x08
 
 /**
  * struct ufs_desc_item - UFS descriptor field information
@@ -204,6 +222,7 @@ static const struct ufs_desc_item ufs_dev_desc[] = {
 
 int init_query_operation(int argc, char *argv[], void *op_data);
 int query_read_descriptor(int fd, int idn, int index, int sel, __u8 *buf, __u16 buf_len);
+int query_read_attribute(int fd, int idn, int index, int sel, __u64 *val);
 int do_query_operation(void *op_data);
 void ufs_desc_translate(__u8 *desc_buf, __u16 len, const struct ufs_desc_item *desc_fields, const char *desc_name);
 
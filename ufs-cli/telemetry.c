@@ -0,0 +1,692 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "lsufs.h"
+#include "telemetry.h"
+#include "throttle.h"
+
+/*
+ * The ring lives in a regular file that is mmap()ed MAP_SHARED by one writer
+ * (the sampler) and any number of readers. Every slot is protected by its own
+ * seqlock: the writer makes the slot sequence odd, updates the slot, then makes
+ * it even again. A reader copies the slot and retries/drops it if the sequence
+ * changed in between, so readers never block the writer and never issue any
+ * command to the UFS device.
+ *
+ * A new writer never resizes a ring file that readers may have mapped, which
+ * would SIGBUS them: it builds its ring in a temporary file and renames it
+ * over the path. Readers keep the old file until they notice and re-attach.
+ * The single writer lock is taken on "<path>.lock", which is never replaced.
+ */
+
+static char *telemetry_short_options = "srfu:q:i:n:c:m:R:d:";
+
+static struct option telemetry_long_options[] = {
+	{"sample", no_argument, NULL, 's'}, /* Run the sampler, i.e. the ring writer */
+	{"read", no_argument, NULL, 'r'}, /* Dump samples from the ring */
+	{"follow", no_argument, NULL, 'f'}, /* Keep dumping new samples */
+	{"uic", required_argument, NULL, 'u'}, /* UIC attributes to sample */
+	{"query", required_argument, NULL, 'q'}, /* Query attributes to sample */
+	{"interval", required_argument, NULL, 'i'}, /* Sampling interval in ms */
+	{"slots", required_argument, NULL, 'n'}, /* Number of slots in the ring */
+	{"count", required_argument, NULL, 'c'}, /* Number of samples to take/dump */
+	{"mem", required_argument, NULL, 'm'}, /* Path to the ring file */
+	{"rate", required_argument, NULL, 'R'}, /* Command rate budget of the sampler */
+	{"device", required_argument, NULL, 'd'}, /* UFS BSG device path. For example: /dev/ufs-bsg0 */
+	{NULL, 0, NULL, 0}
+};
+
+static volatile sig_atomic_t telemetry_stop;
+
+static void telemetry_sig_handler(int sig)
+{
+	(void)sig;
+	telemetry_stop = 1;
+}
+
+static size_t telemetry_ring_size(int nr_slots)
+{
+	return sizeof(struct telemetry_ring_hdr) + (size_t)nr_slots * sizeof(struct telemetry_sample);
+}
+
+static int telemetry_ring_map(struct telemetry_ring *ring, int prot)
+{
+	ring->hdr = mmap(NULL, ring->size, prot, MAP_SHARED, ring->fd, 0);
+	if (ring->hdr == MAP_FAILED) {
+		pr_err("Failed to map telemetry ring (%d)\n", errno);
+		ring->hdr = NULL;
+		return ERROR;
+	}
+
+	ring->slots = (struct telemetry_sample *)(ring->hdr + 1);
+
+	return SUCCESS;
+}
+
+int telemetry_ring_create(struct telemetry_ring *ring, const char *path, struct telemetry_attr *attrs,
+			  int nr_attrs, int nr_slots, int interval_ms)
+{
+	char lock_path[DEVICE_PATH_NAME_SIZE_MAX + 8], tmp_path[DEVICE_PATH_NAME_SIZE_MAX + 8];
+	struct telemetry_ring_hdr *hdr;
+
+	ring->fd = INIT;
+	ring->hdr = NULL;
+	if (nr_attrs <= 0 || nr_attrs > TELEMETRY_MAX_ATTRS || nr_slots <= 0)
+		return ERROR;
+
+	snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+	ring->lock_fd = open(lock_path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (ring->lock_fd < 0) {
+		pr_err("Failed to open telemetry ring lock %s (%d)\n", lock_path, errno);
+		return ERROR;
+	}
+
+	/* Only one sampler may poll the device and publish into a ring */
+	if (flock(ring->lock_fd, LOCK_EX | LOCK_NB)) {
+		pr_err("Telemetry ring %s already has a writer\n", path);
+		goto close_lock;
+	}
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+	ring->fd = mkstemp(tmp_path);
+	if (ring->fd < 0) {
+		pr_err("Failed to create telemetry ring %s (%d)\n", tmp_path, errno);
+		goto close_lock;
+	}
+
+	ring->size = telemetry_ring_size(nr_slots);
+	if (fchmod(ring->fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) || ftruncate(ring->fd, ring->size)) {
+		pr_err("Failed to resize telemetry ring %s (%d)\n", tmp_path, errno);
+		goto unlink_tmp;
+	}
+
+	if (telemetry_ring_map(ring, PROT_READ | PROT_WRITE))
+		goto unlink_tmp;
+
+	hdr = ring->hdr;
+	hdr->version = TELEMETRY_VERSION;
+	hdr->nr_slots = nr_slots;
+	hdr->nr_attrs = nr_attrs;
+	hdr->interval_ms = interval_ms;
+	hdr->writer_pid = getpid();
+	hdr->head = 0;
+	memcpy(hdr->attrs, attrs, nr_attrs * sizeof(*attrs));
+	hdr->magic = TELEMETRY_MAGIC;
+	ring->nr_slots = nr_slots;
+	ring->writer_pid = hdr->writer_pid;
+
+	/* Readers attaching from now on get the complete new ring */
+	if (rename(tmp_path, path)) {
+		pr_err("Failed to publish telemetry ring %s (%d)\n", path, errno);
+		munmap(ring->hdr, ring->size);
+		ring->hdr = NULL;
+		goto unlink_tmp;
+	}
+
+	return SUCCESS;
+
+unlink_tmp:
+	unlink(tmp_path);
+	close(ring->fd);
+	ring->fd = INIT;
+close_lock:
+	close(ring->lock_fd);
+	ring->lock_fd = INIT;
+	return ERROR;
+}
+
+int telemetry_ring_attach(struct telemetry_ring *ring, const char *path)
+{
+	struct telemetry_ring_hdr hdr;
+	struct stat st;
+	ssize_t len;
+
+	ring->lock_fd = INIT;
+	ring->hdr = NULL;
+	ring->fd = open(path, O_RDONLY);
+	if (ring->fd < 0) {
+		pr_err("Failed to open telemetry ring %s (%d)\n", path, errno);
+		return ERROR;
+	}
+
+	len = pread(ring->fd, &hdr, sizeof(hdr), 0);
+	if (len != sizeof(hdr) || hdr.magic != TELEMETRY_MAGIC || hdr.version != TELEMETRY_VERSION ||
+	    !hdr.nr_slots) {
+		pr_err("%s is not a telemetry ring or the sampler is not ready\n", path);
+		goto close_fd;
+	}
+
+	/* Never map past the end of the file, touching that would SIGBUS */
+	ring->size = telemetry_ring_size(hdr.nr_slots);
+	if (fstat(ring->fd, &st) || (size_t)st.st_size < ring->size) {
+		pr_err("Telemetry ring %s is truncated\n", path);
+		goto close_fd;
+	}
+
+	if (telemetry_ring_map(ring, PROT_READ))
+		goto close_fd;
+
+	/* The mapping is sized for these, whatever the header says later */
+	ring->nr_slots = hdr.nr_slots;
+	ring->writer_pid = hdr.writer_pid;
+
+	return SUCCESS;
+
+close_fd:
+	close(ring->fd);
+	ring->fd = INIT;
+	return ERROR;
+}
+
+void telemetry_ring_detach(struct telemetry_ring *ring)
+{
+	if (ring->hdr)
+		munmap(ring->hdr, ring->size);
+	if (ring->fd >= 0)
+		close(ring->fd);
+	/* Dropping the lock lets the next writer in */
+	if (ring->lock_fd >= 0)
+		close(ring->lock_fd);
+
+	ring->hdr = NULL;
+	ring->slots = NULL;
+	ring->fd = INIT;
+	ring->lock_fd = INIT;
+}
+
+/**
+ * telemetry_ring_replaced - Check if a reader should re-attach
+ * @ring: Attached telemetry ring
+ * @path: Path the ring was attached from
+ *
+ * Returns true if a new writer has put another ring at @path, or if the
+ * mapped header no longer is the one attached to.
+ */
+bool telemetry_ring_replaced(struct telemetry_ring *ring, const char *path)
+{
+	struct stat cur, st;
+
+	if (__atomic_load_n(&ring->hdr->magic, __ATOMIC_ACQUIRE) != TELEMETRY_MAGIC ||
+	    __atomic_load_n(&ring->hdr->writer_pid, __ATOMIC_RELAXED) != ring->writer_pid)
+		return true;
+
+	/* A missing path is not a new ring yet */
+	if (stat(path, &st) || fstat(ring->fd, &cur))
+		return false;
+
+	return st.st_ino != cur.st_ino || st.st_dev != cur.st_dev;
+}
+
+/**
+ * telemetry_ring_publish - Publish a sample, must only be called by the ring writer
+ * @ring: Telemetry ring
+ * @sample: Sample to publish, seq and index are filled in here
+ */
+void telemetry_ring_publish(struct telemetry_ring *ring, struct telemetry_sample *sample)
+{
+	struct telemetry_ring_hdr *hdr = ring->hdr;
+	struct telemetry_sample *slot;
+	__u64 n = hdr->head;
+
+	slot = &ring->slots[n % ring->nr_slots];
+
+	__atomic_store_n(&slot->seq, 2 * n + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	sample->index = n;
+	memcpy((__u8 *)slot + sizeof(slot->seq), (__u8 *)sample + sizeof(sample->seq),
+	       sizeof(*slot) - sizeof(slot->seq));
+
+	__atomic_store_n(&slot->seq, 2 * n + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&hdr->head, n + 1, __ATOMIC_RELEASE);
+}
+
+__u64 telemetry_ring_head(struct telemetry_ring *ring)
+{
+	return __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * telemetry_ring_read - Copy out a published sample without blocking the writer
+ * @ring: Telemetry ring
+ * @index: Sample number, must be less than telemetry_ring_head()
+ * @sample: Output sample
+ *
+ * Returns SUCCESS, INIT if the sample is not published yet, or ERROR if the
+ * writer has already recycled its slot.
+ */
+int telemetry_ring_read(struct telemetry_ring *ring, __u64 index, struct telemetry_sample *sample)
+{
+	struct telemetry_sample *slot = &ring->slots[index % ring->nr_slots];
+	__u64 expected = 2 * index + 2;
+	__u64 seq0, seq1;
+
+	do {
+		seq0 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq0 < expected - 1)
+			return INIT;
+		if (seq0 > expected)
+			return ERROR;
+	} while (seq0 & 1);
+
+	memcpy(sample, slot, sizeof(*sample));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	seq1 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+	return seq1 == seq0 ? SUCCESS : ERROR;
+}
+
+static __u64 telemetry_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int parse_number(const char *str, char **end, long *val)
+{
+	errno = 0;
+	*val = strtol(str, end, 0);
+	if (errno || *end == str || *val < 0)
+		return ERROR;
+
+	return SUCCESS;
+}
+
+/* <ID>[:tx<lane>|rx<lane>][:local|peer], separated by ',' */
+static int parse_uic_attrs(struct telemetry_operation *top, char *list)
+{
+	struct telemetry_attr *attr;
+	char *tok, *saveptr, *end;
+	long id, l;
+
+	for (tok = strtok_r(list, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+		if (top->nr_attrs >= TELEMETRY_MAX_ATTRS) {
+			pr_err("Too many attributes, at most %d\n", TELEMETRY_MAX_ATTRS);
+			return ERROR;
+		}
+
+		if (parse_number(tok, &end, &id) || id > 0xFFFF)
+			goto invalid;
+
+		attr = &top->attrs[top->nr_attrs];
+		attr->type = TELEMETRY_ATTR_UIC;
+		attr->id = id;
+		attr->sel = SELECT_TX(0);
+		attr->peer = LOCAL;
+
+		while (*end == ':') {
+			tok = end + 1;
+			if (!strncasecmp(tok, "tx", 2) || !strncasecmp(tok, "rx", 2)) {
+				if (parse_number(tok + 2, &end, &l) || l > 1)
+					goto invalid;
+				attr->sel = (tok[0] == 't' || tok[0] == 'T') ? SELECT_TX(l) : SELECT_RX(l);
+			} else if (!strncmp(tok, "local", 5)) {
+				attr->peer = LOCAL;
+				end = tok + 5;
+			} else if (!strncmp(tok, "peer", 4)) {
+				attr->peer = PEER;
+				end = tok + 4;
+			} else {
+				goto invalid;
+			}
+		}
+
+		if (*end != '\0')
+			goto invalid;
+
+		top->nr_attrs++;
+	}
+
+	return SUCCESS;
+
+invalid:
+	pr_err("Invalid UIC attribute %s\n", tok);
+	return ERROR;
+}
+
+/* <IDN>[:<index>], separated by ',' */
+static int parse_query_attrs(struct telemetry_operation *top, char *list)
+{
+	struct telemetry_attr *attr;
+	char *tok, *saveptr, *end;
+	long idn, index = 0;
+
+	for (tok = strtok_r(list, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+		if (top->nr_attrs >= TELEMETRY_MAX_ATTRS) {
+			pr_err("Too many attributes, at most %d\n", TELEMETRY_MAX_ATTRS);
+			return ERROR;
+		}
+
+		if (parse_number(tok, &end, &idn) || idn > 0xFF)
+			goto invalid;
+
+		if (*end == ':' && (parse_number(end + 1, &end, &index) || index > 0xFF))
+			goto invalid;
+
+		if (*end != '\0')
+			goto invalid;
+
+		attr = &top->attrs[top->nr_attrs++];
+		attr->type = TELEMETRY_ATTR_QUERY;
+		attr->id = idn;
+		attr->sel = index;
+		attr->peer = LOCAL;
+	}
+
+	return SUCCESS;
+
+invalid:
+	pr_err("Invalid Query attribute %s\n", tok);
+	return ERROR;
+}
+
+static int setup_telemetry_operation(int args, char *argv[], struct lsufs_operation *lsufs_op)
+{
+	struct telemetry_operation *top = &lsufs_op->telemetry_op;
+	int i, c = 0, ret = ERROR;
+
+	while (-1 != (c = getopt_long(args, argv, telemetry_short_options, telemetry_long_options, &i))) {
+		switch (c) {
+		case 's':
+			top->sample = true;
+			ret = SUCCESS;
+			break;
+		case 'r':
+			top->sample = false;
+			ret = SUCCESS;
+			break;
+		case 'f':
+			top->follow = true;
+			ret = SUCCESS;
+			break;
+		case 'u':
+			ret = parse_uic_attrs(top, optarg);
+			break;
+		case 'q':
+			ret = parse_query_attrs(top, optarg);
+			break;
+		case 'i':
+			ret = init_positive_value(&top->interval, "sampling interval");
+			break;
+		case 'n':
+			ret = init_positive_value(&top->nr_slots, "number of slots");
+			break;
+		case 'c':
+			ret = init_positive_value(&top->count, "count");
+			break;
+		case 'm':
+			ret = init_device_path(top->ring_path);
+			break;
+		case 'R':
+			ret = init_positive_value(&top->rate, "command rate");
+			break;
+		case 'd':
+			ret = init_device_path(lsufs_op->device_path);
+			break;
+		default:
+			pr_err("I cannot understand, please try 'telemetry -h'.\n");
+			ret = ERROR;
+			break;
+		}
+
+		if (ret)
+			break;
+	}
+
+	return ret;
+}
+
+static int telemetry_op_sanity_check(struct lsufs_operation *lsufs_op)
+{
+	struct telemetry_operation *top = &lsufs_op->telemetry_op;
+
+	if (top->ring_path[0] == '\0') {
+		strcpy(top->ring_path, TELEMETRY_RING_PATH_DEFAULT);
+		printf("Ring path is not given, use %s.\n", top->ring_path);
+	}
+
+	if (!top->sample)
+		return SUCCESS;
+
+	if (lsufs_op->device_path[0] == '\0') {
+		pr_err("Path to bsg device not provided.\n");
+		return ERROR;
+	}
+
+	if (!top->nr_attrs) {
+		pr_err("No attribute to sample.\n");
+		return ERROR;
+	}
+
+	if (top->interval == INIT)
+		top->interval = TELEMETRY_INTERVAL_DEFAULT;
+
+	if (top->nr_slots == INIT)
+		top->nr_slots = TELEMETRY_SLOTS_DEFAULT;
+
+	if (top->rate && throttle_init(top->rate, top->nr_attrs))
+		return ERROR;
+
+	return SUCCESS;
+}
+
+int init_telemetry_operation(int argc, char *argv[], void *op_data)
+{
+	struct lsufs_operation *lsufs_op = (struct lsufs_operation *)op_data;
+	struct telemetry_operation *top = &lsufs_op->telemetry_op;
+	int ret;
+
+	memset(top, 0, sizeof(*top));
+	top->interval = INIT;
+	top->nr_slots = INIT;
+	top->count = INIT;
+	lsufs_op->device_path[0] = '\0';
+
+	ret = setup_telemetry_operation(argc, argv, lsufs_op);
+
+	return ret ? ret : telemetry_op_sanity_check(lsufs_op);
+}
+
+static void telemetry_take_sample(int fd, struct telemetry_ring_hdr *hdr, struct telemetry_sample *sample)
+{
+	struct telemetry_attr *attr;
+	__u64 val;
+	int i, ret;
+
+	sample->err_mask = 0;
+	sample->timestamp_ns = telemetry_now_ns();
+
+	for (i = 0; i < hdr->nr_attrs; i++) {
+		attr = &hdr->attrs[i];
+		if (attr->type == TELEMETRY_ATTR_UIC) {
+			ret = uic_get(fd, UIC_ARG_MIB_SEL(attr->id, attr->sel), attr->peer);
+			val = ret;
+		} else {
+			ret = query_read_attribute(fd, attr->id, attr->sel, 0, &val);
+		}
+
+		if (ret < 0) {
+			sample->err_mask |= 1 << i;
+			val = 0;
+		}
+
+		sample->values[i] = val;
+	}
+}
+
+static int do_telemetry_sample(struct lsufs_operation *lsufs_op)
+{
+	struct telemetry_operation *top = &lsufs_op->telemetry_op;
+	struct telemetry_ring ring = {0};
+	struct telemetry_sample sample = {0};
+	struct timespec next;
+	int n, fd, ret;
+
+	fd = open(lsufs_op->device_path, O_RDWR);
+	if (fd < 0) {
+		pr_err("Failed to open file %s (%d).\n", lsufs_op->device_path, fd);
+		return ERROR;
+	}
+
+	ret = telemetry_ring_create(&ring, top->ring_path, top->attrs, top->nr_attrs,
+				    top->nr_slots, top->interval);
+	if (ret)
+		goto close_fd;
+
+	signal(SIGINT, telemetry_sig_handler);
+	signal(SIGTERM, telemetry_sig_handler);
+
+	printf("Sampling %d attributes every %d ms into %s, %d slots\n", top->nr_attrs, top->interval,
+	       top->ring_path, top->nr_slots);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (n = 0; !telemetry_stop && (top->count == INIT || n < top->count); n++) {
+		telemetry_take_sample(fd, ring.hdr, &sample);
+		telemetry_ring_publish(&ring, &sample);
+
+		next.tv_nsec += (long)top->interval * 1000000L;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	printf("Published %d samples\n", n);
+	telemetry_ring_detach(&ring);
+close_fd:
+	close(fd);
+
+	return ret;
+}
+
+static void telemetry_print_attr_name(struct telemetry_attr *attr)
+{
+	int id;
+
+	if (attr->type == TELEMETRY_ATTR_UIC) {
+		id = characteristics_look_up(unipro_mphy_attrs, attr->id);
+		printf("%s %s[%s%d]", attr->peer ? "peer" : "local", id < 0 ? "???" : unipro_mphy_attrs[id].name,
+		       attr->sel >= SELECT_RX(0) ? "rx" : "tx",
+		       attr->sel >= SELECT_RX(0) ? attr->sel - SELECT_RX(0) : attr->sel);
+	} else {
+		id = characteristics_look_up(ufs_attributes, attr->id);
+		printf("%s[%d]", id < 0 ? "???" : ufs_attributes[id].name, attr->sel);
+	}
+}
+
+static void telemetry_print_sample(struct telemetry_ring_hdr *hdr, struct telemetry_sample *sample)
+{
+	int i;
+
+	printf("#%llu %llu.%09llu", (unsigned long long)sample->index,
+	       (unsigned long long)(sample->timestamp_ns / 1000000000ULL),
+	       (unsigned long long)(sample->timestamp_ns % 1000000000ULL));
+
+	for (i = 0; i < hdr->nr_attrs; i++) {
+		if (sample->err_mask & (1 << i))
+			printf(" ---");
+		else
+			printf(" 0x%llx", (unsigned long long)sample->values[i]);
+	}
+
+	printf("\n");
+}
+
+static void telemetry_print_ring(const char *path, struct telemetry_ring *ring)
+{
+	struct telemetry_ring_hdr *hdr = ring->hdr;
+	int i;
+
+	printf("Telemetry ring %s: writer pid %u, interval %u ms, %u slots\n", path, ring->writer_pid,
+	       hdr->interval_ms, ring->nr_slots);
+	for (i = 0; i < hdr->nr_attrs; i++) {
+		printf("  [%d] ", i);
+		telemetry_print_attr_name(&hdr->attrs[i]);
+		printf("\n");
+	}
+}
+
+static int do_telemetry_read(struct lsufs_operation *lsufs_op)
+{
+	struct telemetry_operation *top = &lsufs_op->telemetry_op;
+	struct telemetry_ring ring = {0};
+	struct telemetry_sample sample;
+	__u64 head, idx, dropped = 0;
+	int ret;
+
+	ret = telemetry_ring_attach(&ring, top->ring_path);
+	if (ret)
+		return ret;
+
+	telemetry_print_ring(top->ring_path, &ring);
+
+	signal(SIGINT, telemetry_sig_handler);
+	signal(SIGTERM, telemetry_sig_handler);
+
+	/* Start from the latest 'count' samples, or the latest one only */
+	head = telemetry_ring_head(&ring);
+	idx = top->count == INIT ? head - (head ? 1 : 0) : head - MIN(head, (__u64)top->count);
+	if (head - idx > ring.nr_slots)
+		idx = head - ring.nr_slots;
+
+	while (!telemetry_stop) {
+		head = telemetry_ring_head(&ring);
+		for (; idx < head; idx++) {
+			if (telemetry_ring_read(&ring, idx, &sample)) {
+				/* Recycled by the writer while we were behind, skip it */
+				dropped++;
+				continue;
+			}
+			telemetry_print_sample(ring.hdr, &sample);
+		}
+
+		if (!top->follow)
+			break;
+
+		fflush(stdout);
+
+		/* A new sampler started over in a new ring, follow it from its first sample */
+		if (telemetry_ring_replaced(&ring, top->ring_path)) {
+			telemetry_ring_detach(&ring);
+			ret = telemetry_ring_attach(&ring, top->ring_path);
+			if (ret)
+				break;
+
+			telemetry_print_ring(top->ring_path, &ring);
+			head = telemetry_ring_head(&ring);
+			idx = head > ring.nr_slots ? head - ring.nr_slots : 0;
+			continue;
+		}
+
+		usleep(ring.hdr->interval_ms * 500);
+	}
+
+	if (dropped)
+		printf("Dropped %llu overwritten samples\n", (unsigned long long)dropped);
+
+	telemetry_ring_detach(&ring);
+
+	return ret;
+}
+
+int do_telemetry_operation(void *op_data)
+{
+	struct lsufs_operation *lsufs_op = (struct lsufs_operation *)op_data;
+
+	if (lsufs_op->telemetry_op.sample)
+		return do_telemetry_sample(lsufs_op);
+
+	return do_telemetry_read(lsufs_op);
+}
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <linux/types.h>
+#include <sys/types.h>
+#include <stddef.h>
+#include "common.h"
+
+#define TELEMETRY_MAGIC			0x55465354	/* "UFST" */
+#define TELEMETRY_VERSION		1
+#define TELEMETRY_MAX_ATTRS		16
+#define TELEMETRY_SLOTS_DEFAULT		1024
+#define TELEMETRY_INTERVAL_DEFAULT	1000	/* ms */
+#define TELEMETRY_RING_PATH_DEFAULT	"/dev/shm/ufs-telemetry"
+
+enum telemetry_attr_type {
+	TELEMETRY_ATTR_UIC,
+	TELEMETRY_ATTR_QUERY,
+};
+
+/**
+ * struct telemetry_attr - One sampled attribute
+ * @type: UIC (DME_GET/DME_PEER_GET) or Query (read attribute)
+ * @id: UniPro/M-PHY Attribute ID or Query Attribute IDN
+ * @sel: GenSelectorIndex (UIC) or Index (Query)
+ * @peer: LOCAL/PEER, UIC only
+ */
+struct telemetry_attr {
+	__u16 type;
+	__u16 id;
+	__u16 sel;
+	__u16 peer;
+};
+
+/**
+ * struct telemetry_sample - One published sample
+ * @seq: Seqlock sequence, odd while the writer is updating the slot
+ * @index: Sample number since the ring was created
+ * @timestamp_ns: CLOCK_MONOTONIC time the sample was taken
+ * @err_mask: Bit n is set if attrs[n] failed to be read
+ * @values: Attribute values, in the order of the ring header attrs[]
+ */
+struct telemetry_sample {
+	__u64 seq;
+	__u64 index;
+	__u64 timestamp_ns;
+	__u32 err_mask;
+	__u32 reserved;
+	__u64 values[TELEMETRY_MAX_ATTRS];
+};
+
+/**
+ * struct telemetry_ring_hdr - Shared memory ring header
+ * @magic: TELEMETRY_MAGIC
+ * @version: TELEMETRY_VERSION
+ * @nr_slots: Number of sample slots following the header
+ * @nr_attrs: Number of valid entries in attrs[]
+ * @interval_ms: Sampling interval of the writer
+ * @writer_pid: Process ID of the (single) writer
+ * @head: Number of samples published so far, the latest is head - 1
+ * @attrs: Sampled attributes
+ */
+struct telemetry_ring_hdr {
+	__u32 magic;
+	__u32 version;
+	__u32 nr_slots;
+	__u32 nr_attrs;
+	__u32 interval_ms;
+	__u32 writer_pid;
+	__u64 head;
+	struct telemetry_attr attrs[TELEMETRY_MAX_ATTRS];
+};
+
+/**
+ * struct telemetry_ring - A mapped ring
+ * @fd: Ring file
+ * @lock_fd: Writer lock file "<path>.lock", writer only
+ * @size: Mapped size
+ * @nr_slots: Number of slots of the mapping, as attached
+ * @writer_pid: Writer of the ring, as attached
+ * @hdr: Mapped ring header
+ * @slots: Mapped sample slots
+ */
+struct telemetry_ring {
+	int fd;
+	int lock_fd;
+	size_t size;
+	__u32 nr_slots;
+	__u32 writer_pid;
+	struct telemetry_ring_hdr *hdr;
+	struct telemetry_sample *slots;
+};
+
+struct telemetry_operation {
+	bool sample;
+	bool follow;
+	int interval;
+	int nr_slots;
+	int count;
+	int rate;
+	int nr_attrs;
+	struct telemetry_attr attrs[TELEMETRY_MAX_ATTRS];
+	char ring_path[DEVICE_PATH_NAME_SIZE_MAX];
+};
+
+int telemetry_ring_create(struct telemetry_ring *ring, const char *path, struct telemetry_attr *attrs,
+			  int nr_attrs, int nr_slots, int interval_ms);
+int telemetry_ring_attach(struct telemetry_ring *ring, const char *path);
+void telemetry_ring_detach(struct telemetry_ring *ring);
+bool telemetry_ring_replaced(struct telemetry_ring *ring, const char *path);
+void telemetry_ring_publish(struct telemetry_ring *ring, struct telemetry_sample *sample);
+__u64 telemetry_ring_head(struct telemetry_ring *ring);
+int telemetry_ring_read(struct telemetry_ring *ring, __u64 index, struct telemetry_sample *sample);
+
+int init_telemetry_operation(int argc, char *argv[], void *op_data);
+int do_telemetry_operation(void *op_data);
+#endif /* __TELEMETRY_H__ */
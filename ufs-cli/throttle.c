@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include "throttle.h"
+
+/*
+ * Token bucket shared by every UIC and Query command sent through ufs_bsg_io().
+ * The bucket refills at 'rate' commands per second up to 'burst' tokens, and a
+ * command waits until a full token is available.
+ *
+ * In feedback mode the refill rate is additionally scaled down (AIMD) whenever
+ * the average completion latency of the foreground block I/O, taken from
+ * /sys/block/<dev>/stat, goes above the latency target.
+ */
+
+struct blk_stat {
+	unsigned long long ios;
+	unsigned long long ticks;	/* ms */
+};
+
+struct throttle {
+	bool enabled;
+	double rate;		/* budget, commands per second */
+	double cur_rate;	/* budget after feedback */
+	double burst;
+	double tokens;
+	__u64 last_ns;
+
+	/* Feedback */
+	int nr_blk_devs;
+	char blk_devs[THROTTLE_BLK_DEVS_MAX][32];
+	struct blk_stat last_stat;
+	__u64 window_start_ns;
+	double latency_target_us;
+	double latency_best_us;
+
+	/* Statistics */
+	unsigned long long cmds;
+	unsigned long long waits;
+	unsigned long long backoffs;
+	__u64 wait_ns;
+	double min_rate;
+};
+
+static struct throttle throttle;
+
+static __u64 throttle_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int throttle_init(int rate, int burst)
+{
+	if (rate <= 0) {
+		pr_err("Invalid command rate %d\n", rate);
+		return ERROR;
+	}
+
+	throttle.rate = rate;
+	throttle.cur_rate = rate;
+	throttle.min_rate = rate;
+	throttle.burst = burst > 0 ? burst : 1;
+	throttle.tokens = throttle.burst;
+	throttle.last_ns = throttle_now_ns();
+	throttle.enabled = true;
+
+	return SUCCESS;
+}
+
+static int read_blk_stat(struct blk_stat *stat)
+{
+	unsigned long long rd_ios, rd_merges, rd_sectors, rd_ticks;
+	unsigned long long wr_ios, wr_merges, wr_sectors, wr_ticks;
+	char path[64];
+	FILE *file;
+	int i, n;
+
+	stat->ios = 0;
+	stat->ticks = 0;
+
+	for (i = 0; i < throttle.nr_blk_devs; i++) {
+		snprintf(path, sizeof(path), "/sys/block/%s/stat", throttle.blk_devs[i]);
+		file = fopen(path, "r");
+		if (!file)
+			return ERROR;
+
+		n = fscanf(file, "%llu %llu %llu %llu %llu %llu %llu %llu", &rd_ios, &rd_merges, &rd_sectors,
+			   &rd_ticks, &wr_ios, &wr_merges, &wr_sectors, &wr_ticks);
+		fclose(file);
+		if (n != 8)
+			return ERROR;
+
+		stat->ios += rd_ios + wr_ios;
+		stat->ticks += rd_ticks + wr_ticks;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * throttle_init_feedback - Enable block layer latency feedback
+ * @blk_devs: Comma separated block device names, e.g. "sda,sdc"
+ * @latency_us: Average foreground I/O latency target, 0 to derive it from the
+ *		best latency observed while running
+ */
+int throttle_init_feedback(char *blk_devs, int latency_us)
+{
+	char *tok, *saveptr;
+
+	if (!throttle.enabled) {
+		pr_err("Latency feedback needs a command rate\n");
+		return ERROR;
+	}
+
+	for (tok = strtok_r(blk_devs, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+		if (throttle.nr_blk_devs >= THROTTLE_BLK_DEVS_MAX || strlen(tok) >= sizeof(throttle.blk_devs[0])) {
+			pr_err("Too many or invalid block devices\n");
+			return ERROR;
+		}
+		strcpy(throttle.blk_devs[throttle.nr_blk_devs++], tok);
+	}
+
+	if (read_blk_stat(&throttle.last_stat)) {
+		pr_err("Failed to read block device statistics for %s\n", blk_devs);
+		throttle.nr_blk_devs = 0;
+		return ERROR;
+	}
+
+	throttle.latency_target_us = latency_us;
+	throttle.latency_best_us = 0;
+	throttle.window_start_ns = throttle_now_ns();
+
+	return SUCCESS;
+}
+
+static void throttle_feedback(__u64 now)
+{
+	struct blk_stat stat;
+	double latency_us, target_us;
+	unsigned long long ios;
+
+	if (now - throttle.window_start_ns < THROTTLE_FEEDBACK_WINDOW_MS * 1000000ULL)
+		return;
+
+	throttle.window_start_ns = now;
+	if (read_blk_stat(&stat))
+		return;
+
+	ios = stat.ios - throttle.last_stat.ios;
+	latency_us = ios ? (double)(stat.ticks - throttle.last_stat.ticks) * 1000 / ios : 0;
+	throttle.last_stat = stat;
+
+	if (ios && (throttle.latency_best_us == 0 || latency_us < throttle.latency_best_us))
+		throttle.latency_best_us = latency_us;
+
+	target_us = throttle.latency_target_us;
+	if (target_us == 0)
+		target_us = throttle.latency_best_us * THROTTLE_LATENCY_BASELINE_MUL;
+
+	if (ios && latency_us > target_us) {
+		/* Foreground I/O is suffering, back off multiplicatively */
+		throttle.cur_rate /= 2;
+		if (throttle.cur_rate < throttle.rate / THROTTLE_MIN_RATE_DIV)
+			throttle.cur_rate = throttle.rate / THROTTLE_MIN_RATE_DIV;
+		if (throttle.cur_rate < throttle.min_rate)
+			throttle.min_rate = throttle.cur_rate;
+		throttle.backoffs++;
+	} else {
+		/* Recover additively */
+		throttle.cur_rate += throttle.rate / 10;
+		if (throttle.cur_rate > throttle.rate)
+			throttle.cur_rate = throttle.rate;
+	}
+}
+
+/**
+ * throttle_wait - Take a token for one command, sleeping until one is available
+ */
+void throttle_wait(void)
+{
+	struct timespec ts;
+	__u64 now, delay_ns;
+
+	if (!throttle.enabled)
+		return;
+
+	now = throttle_now_ns();
+	if (throttle.nr_blk_devs)
+		throttle_feedback(now);
+
+	throttle.tokens += (double)(now - throttle.last_ns) * throttle.cur_rate / 1e9;
+	if (throttle.tokens > throttle.burst)
+		throttle.tokens = throttle.burst;
+	throttle.last_ns = now;
+
+	if (throttle.tokens < 1) {
+		delay_ns = (__u64)((1 - throttle.tokens) * 1e9 / throttle.cur_rate);
+		ts.tv_sec = delay_ns / 1000000000ULL;
+		ts.tv_nsec = delay_ns % 1000000000ULL;
+		while (nanosleep(&ts, &ts) && errno == EINTR)
+			;
+
+		throttle.tokens = 1;
+		throttle.last_ns = throttle_now_ns();
+		throttle.waits++;
+		throttle.wait_ns += throttle.last_ns - now;
+	}
+
+	throttle.tokens -= 1;
+	throttle.cmds++;
+}
+
+void throttle_stats(void)
+{
+	if (!throttle.enabled)
+		return;
+
+	printf("Command throttle: %llu commands, %llu waited for %.3f s in total, budget %.0f/s",
+	       throttle.cmds, throttle.waits, throttle.wait_ns / 1e9, throttle.rate);
+
+	if (throttle.nr_blk_devs)
+		printf(", %llu back-offs, lowest rate %.1f/s, best I/O latency %.0f us",
+		       throttle.backoffs, throttle.min_rate, throttle.latency_best_us);
+
+	printf("\n");
+}
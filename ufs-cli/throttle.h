@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#ifndef __THROTTLE_H__
+#define __THROTTLE_H__
+
+#include "common.h"
+
+#define THROTTLE_BLK_DEVS_MAX		8
+#define THROTTLE_FEEDBACK_WINDOW_MS	100
+/* Never go below 1/THROTTLE_MIN_RATE_DIV of the budget while backing off */
+#define THROTTLE_MIN_RATE_DIV		64
+/* Without a given latency target, back off at twice the best latency seen */
+#define THROTTLE_LATENCY_BASELINE_MUL	2
+
+int throttle_init(int rate, int burst);
+int throttle_init_feedback(char *blk_devs, int latency_us);
+void throttle_wait(void);
+void throttle_stats(void);
+#endif /* __THROTTLE_H__ */
@@ -0,0 +1,713 @@
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+/*
+ * Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <linux/fs.h>
+#include <linux/types.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <malloc.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "query.h"
+#include "uic.h"
+#include "throttle.h"
+
+#define BENCH_VERSION  "1.0"
+
+#define BENCH_QD_DEFAULT		8
+#define BENCH_QD_MAX			64
+#define BENCH_BS_DEFAULT		4096
+#define BENCH_SIZE_DEFAULT		256	/* MB, only used to create the target file */
+#define BENCH_TIME_DEFAULT		10	/* seconds per step */
+#define BENCH_WARMUP_TIME		1	/* seconds, not accounted */
+#define BENCH_RATES_DEFAULT		"10,100,1000"
+#define BENCH_RATES_MAX			16
+#define BENCH_MEM_ALIGN_SIZE		4096
+#define BENCH_FILL_CHUNK_SIZE		(1024 * 1024)
+/* Target test count of the eom command measurements, the ufseom default */
+#define BENCH_EOM_TARGET_COUNT		0x5D
+
+/* Log-linear latency histogram in us, 32 sub-buckets per power of 2 */
+#define LAT_SUB_BITS			5
+#define LAT_BUCKETS			(64 << LAT_SUB_BITS)
+
+enum bench_cmd_type {
+	BENCH_CMD_DME_GET,
+	BENCH_CMD_DME_PEER_GET,
+	BENCH_CMD_QUERY,
+	BENCH_CMD_EOM,
+	BENCH_CMD_MAX,
+};
+
+static const char *bench_cmd_names[BENCH_CMD_MAX] = {
+	"dme_get",
+	"dme_peer_get",
+	"query",
+	"eom",
+};
+
+struct bench_worker {
+	pthread_t thread;
+	int id;
+	char *buf;
+	__u64 seed;
+	unsigned long long ios;
+	unsigned long long errors;
+	unsigned long long lat[LAT_BUCKETS];
+};
+
+struct bench_result {
+	const char *cmd;
+	int rate;
+	double achieved_rate;
+	unsigned long long cmd_errors;
+	unsigned long long io_errors;
+	double iops;
+	double mbps;
+	__u64 p50;
+	__u64 p99;
+	__u64 p999;
+	__u64 max;
+};
+
+static char device_path[DEVICE_PATH_NAME_SIZE_MAX];
+static char target_path[DEVICE_PATH_NAME_SIZE_MAX];
+static char output_path[DEVICE_PATH_NAME_SIZE_MAX];
+static int bench_qd;
+static int bench_bs;
+static int bench_write_pct;
+static int bench_time;
+static int bench_size;
+static bool bench_force;
+static bool bench_cmds[BENCH_CMD_MAX];
+static int bench_rates[BENCH_RATES_MAX];
+static int bench_nr_rates;
+
+static int bsg_fd, target_fd;
+static __u64 target_blocks;
+static volatile int bench_stop;
+static volatile int bench_accounting;
+static struct bench_worker workers[BENCH_QD_MAX];
+
+const char *ufsbench_help =
+	"\nufsbench cli :\n\n"
+	"ufsbench [-f | --file <target>] [-q | --qd <queue depth>] [-b | --bs <block size>] [-w | --write <percent>] [-s | --size <MB>] [-t | --time <seconds>] [-c | --cmd <command types>] [-r | --rates <rates>] [--force] [-o | --output <csv file>] [-d | --device <device>]\n\n"
+	"Measures how much UIC and Query commands issued at given rates degrade a foreground block workload.\n"
+	"A baseline without any command is run first, then one step per command type and rate.\n\n"
+	"-h : help\n"
+	"--version : ufsbench version\n"
+	"-f | --file : target of the foreground workload, a new file, or with --force an existing file or block device\n"
+	"-q | --qd : foreground queue depth (number of outstanding O_DIRECT I/Os), defaults to 8\n"
+	"-b | --bs : foreground block size in bytes, defaults to 4096\n"
+	"-w | --write : percentage of writes in the foreground workload, defaults to 0\n"
+	"-s | --size : size in MB of the target file when it has to be created, defaults to 256\n"
+	"-t | --time : seconds measured per step, defaults to 10\n"
+	"-c | --cmd : comma separated command types among dme_get, dme_peer_get, query and eom, defaults to all.\n"
+	"             eom starts the device Rx0 Eye Monitor and polls it, restarting it whenever it completes\n"
+	"-r | --rates : comma separated command rates in commands/s, defaults to " BENCH_RATES_DEFAULT "\n"
+	"--force : allow an existing target file or block device, its content may be destroyed\n"
+	"-o | --output : also save the results as CSV to the given file\n"
+	"-d | --device : path to ufs-bsg device\n\n"
+	"Example:\n"
+	"  1. Random reads at QD 8 on a scratch file, against every command type at 10, 100 and 1000 commands/s:\n"
+	"  ufsbench -f /data/ufsbench_tmp -d /dev/ufs-bsg0\n"
+	"  2. 70/30 read/write mix at QD 32 on the same scratch file, EOM polling only:\n"
+	"  ufsbench -f /data/ufsbench_tmp --force -q 32 -w 30 -c eom -r 50,200,800,3200 -d /dev/ufs-bsg0\n";
+
+static char *ufsbench_short_options = "f:q:b:w:s:t:c:r:o:d:";
+
+static struct option ufsbench_long_options[] = {
+	{"file", required_argument, NULL, 'f'}, /* Foreground workload target */
+	{"qd", required_argument, NULL, 'q'}, /* Foreground queue depth */
+	{"bs", required_argument, NULL, 'b'}, /* Foreground block size */
+	{"write", required_argument, NULL, 'w'}, /* Foreground write percentage */
+	{"size", required_argument, NULL, 's'}, /* Target file size */
+	{"time", required_argument, NULL, 't'}, /* Seconds per step */
+	{"cmd", required_argument, NULL, 'c'}, /* Command types */
+	{"rates", required_argument, NULL, 'r'}, /* Command rates */
+	{"output", required_argument, NULL, 'o'}, /* CSV output */
+	{"device", required_argument, NULL, 'd'}, /* UFS BSG device path. For example: /dev/ufs-bsg0 */
+	{"force", no_argument, NULL, 1}, /* Allow writes to a block device */
+	{NULL, 0, NULL, 0}
+};
+
+static __u64 bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static __u64 fast_rand64(__u64 *seed)
+{
+	__u64 val = *seed;
+
+	val = (3935559000370003845LL * val + 3037000493LL);
+	*seed = val;
+
+	return val & 0x7FFFFFFFFFFFFFFFLL;
+}
+
+static int lat_bucket(__u64 us)
+{
+	int msb;
+
+	if (us < (1 << LAT_SUB_BITS))
+		return us;
+
+	msb = 63 - __builtin_clzll(us);
+
+	return ((msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) +
+	       ((us >> (msb - LAT_SUB_BITS)) & ((1 << LAT_SUB_BITS) - 1));
+}
+
+static __u64 lat_bucket_value(int idx)
+{
+	int group = idx >> LAT_SUB_BITS;
+	int sub = idx & ((1 << LAT_SUB_BITS) - 1);
+
+	if (!group)
+		return sub;
+
+	return (__u64)((1 << LAT_SUB_BITS) + sub) << (group - 1);
+}
+
+static void *bench_worker_fn(void *arg)
+{
+	struct bench_worker *w = arg;
+	__u64 start, end, off;
+	ssize_t len;
+	bool write;
+
+	while (!__atomic_load_n(&bench_stop, __ATOMIC_RELAXED)) {
+		off = (fast_rand64(&w->seed) % target_blocks) * bench_bs;
+		write = (int)(fast_rand64(&w->seed) % 100) < bench_write_pct;
+
+		start = bench_now_ns();
+		if (write)
+			len = pwrite(target_fd, w->buf, bench_bs, off);
+		else
+			len = pread(target_fd, w->buf, bench_bs, off);
+		end = bench_now_ns();
+
+		if (!__atomic_load_n(&bench_accounting, __ATOMIC_RELAXED))
+			continue;
+
+		if (len != bench_bs) {
+			w->errors++;
+			continue;
+		}
+
+		w->ios++;
+		w->lat[lat_bucket((end - start) / 1000)]++;
+	}
+
+	return NULL;
+}
+
+static int bench_issue_cmd(int type)
+{
+	__u64 val;
+	int ret;
+
+	switch (type) {
+	case BENCH_CMD_DME_GET:
+		return uic_get(bsg_fd, UIC_ARG_MIB_SEL(PA_RXGEAR, SELECT_RX(0)), LOCAL);
+	case BENCH_CMD_DME_PEER_GET:
+		return uic_get(bsg_fd, UIC_ARG_MIB_SEL(PA_RXGEAR, SELECT_RX(0)), PEER);
+	case BENCH_CMD_QUERY:
+		/* bCurrentPowerMode */
+		return query_read_attribute(bsg_fd, 0x02, 0, 0, &val);
+	case BENCH_CMD_EOM:
+		/* What ufseom polls while an EOM measurement is running, restarted once it completes */
+		ret = uic_get(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_START, SELECT_RX(0)), PEER);
+		if (ret < 0 || (ret & RX_EYEMON_START_MASK))
+			return ret;
+		return uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_START, SELECT_RX(0)), ATTR_SET_NOR, 1, PEER);
+	}
+
+	return ERROR;
+}
+
+/*
+ * Enable the device Rx0 Eye Monitor at the eye center and start it, the way
+ * ufseom restarts a measurement in incremental mode, so that the eom command
+ * polls a running measurement.
+ */
+static int bench_eom_start(void)
+{
+	static const __u32 attrs[][2] = {
+		{RX_EYEMON_ENABLE, 1},
+		{RX_EYEMON_TIMING_STEPS, 0},
+		{RX_EYEMON_VOLTAGE_STEPS, 0},
+		{RX_EYEMON_TARGET_TEST_COUNT, BENCH_EOM_TARGET_COUNT},
+		{RX_EYEMON_START, 1},
+	};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(attrs) / sizeof(attrs[0]); i++) {
+		if (uic_set(bsg_fd, UIC_ARG_MIB_SEL(attrs[i][0], SELECT_RX(0)), ATTR_SET_NOR, attrs[i][1], PEER)) {
+			pr_err("Failed to start the Eye Monitor (attribute 0x%x)\n", attrs[i][0]);
+			return ERROR;
+		}
+	}
+
+	return SUCCESS;
+}
+
+static void bench_eom_stop(void)
+{
+	if (uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_ENABLE, SELECT_RX(0)), ATTR_SET_NOR, 0, PEER))
+		pr_err("Failed to disable the Eye Monitor\n");
+}
+
+static int bench_step(int type, int rate, struct bench_result *res)
+{
+	unsigned long long lat[LAT_BUCKETS] = {0};
+	unsigned long long ios = 0, io_errors = 0, cmds = 0, cmd_errors = 0, acc, p50_at, p99_at, p999_at;
+	__u64 start, stop, warmup_end, elapsed;
+	int i, j, ret;
+
+	for (i = 0; i < bench_qd; i++) {
+		workers[i].ios = 0;
+		workers[i].errors = 0;
+		memset(workers[i].lat, 0, sizeof(workers[i].lat));
+	}
+
+	if (rate && throttle_init(rate, 1))
+		return ERROR;
+
+	if (rate && type == BENCH_CMD_EOM && bench_eom_start())
+		return ERROR;
+
+	bench_stop = 0;
+	bench_accounting = 0;
+	for (i = 0; i < bench_qd; i++) {
+		ret = pthread_create(&workers[i].thread, NULL, bench_worker_fn, &workers[i]);
+		if (ret) {
+			pr_err("Failed to create worker thread (%d)\n", ret);
+			__atomic_store_n(&bench_stop, 1, __ATOMIC_RELAXED);
+			for (j = 0; j < i; j++)
+				pthread_join(workers[j].thread, NULL);
+			if (rate && type == BENCH_CMD_EOM)
+				bench_eom_stop();
+			return ERROR;
+		}
+	}
+
+	warmup_end = bench_now_ns() + BENCH_WARMUP_TIME * 1000000000ULL;
+	while (bench_now_ns() < warmup_end)
+		usleep(10000);
+
+	__atomic_store_n(&bench_accounting, 1, __ATOMIC_RELAXED);
+	start = bench_now_ns();
+	stop = start + (__u64)bench_time * 1000000000ULL;
+
+	/* The calling thread is the diagnostic command issuer */
+	while (bench_now_ns() < stop) {
+		if (!rate) {
+			usleep(10000);
+			continue;
+		}
+
+		if (bench_issue_cmd(type) < 0)
+			cmd_errors++;
+		cmds++;
+	}
+
+	__atomic_store_n(&bench_accounting, 0, __ATOMIC_RELAXED);
+	elapsed = bench_now_ns() - start;
+	__atomic_store_n(&bench_stop, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < bench_qd; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	if (rate && type == BENCH_CMD_EOM)
+		bench_eom_stop();
+
+	for (i = 0; i < bench_qd; i++) {
+		ios += workers[i].ios;
+		io_errors += workers[i].errors;
+		for (j = 0; j < LAT_BUCKETS; j++)
+			lat[j] += workers[i].lat[j];
+	}
+
+	res->cmd = rate ? bench_cmd_names[type] : "baseline";
+	res->rate = rate;
+	res->achieved_rate = cmds * 1e9 / elapsed;
+	res->cmd_errors = cmd_errors;
+	res->io_errors = io_errors;
+	res->iops = ios * 1e9 / elapsed;
+	res->mbps = res->iops * bench_bs / (1024 * 1024);
+	res->p50 = res->p99 = res->p999 = res->max = 0;
+
+	p50_at = (ios * 50 + 99) / 100;
+	p99_at = (ios * 99 + 99) / 100;
+	p999_at = (ios * 999 + 999) / 1000;
+	for (j = 0, acc = 0; j < LAT_BUCKETS; j++) {
+		if (!lat[j])
+			continue;
+		acc += lat[j];
+		if (!res->p50 && acc >= p50_at)
+			res->p50 = lat_bucket_value(j);
+		if (!res->p99 && acc >= p99_at)
+			res->p99 = lat_bucket_value(j);
+		if (!res->p999 && acc >= p999_at)
+			res->p999 = lat_bucket_value(j);
+		res->max = lat_bucket_value(j);
+	}
+
+	return SUCCESS;
+}
+
+static double pct_change(double val, double base)
+{
+	return base ? (val - base) * 100 / base : 0;
+}
+
+static void print_result(struct bench_result *res, struct bench_result *base, FILE *csv)
+{
+	printf("%-13s %6d %9.1f %7llu %6llu %9.0f %8.1f %8llu %8llu %9llu %+8.1f %+8.1f %+8.1f\n",
+	       res->cmd, res->rate, res->achieved_rate, res->cmd_errors, res->io_errors, res->iops, res->mbps,
+	       (unsigned long long)res->p50, (unsigned long long)res->p99, (unsigned long long)res->p999,
+	       pct_change(res->iops, base->iops), pct_change(res->p99, base->p99),
+	       pct_change(res->p999, base->p999));
+	fflush(stdout);
+
+	if (csv)
+		fprintf(csv, "%s,%d,%.1f,%llu,%llu,%.0f,%.1f,%llu,%llu,%llu,%llu,%.2f,%.2f,%.2f\n",
+			res->cmd, res->rate, res->achieved_rate, res->cmd_errors, res->io_errors, res->iops, res->mbps,
+			(unsigned long long)res->p50, (unsigned long long)res->p99,
+			(unsigned long long)res->p999, (unsigned long long)res->max,
+			pct_change(res->iops, base->iops), pct_change(res->p99, base->p99),
+			pct_change(res->p999, base->p999));
+}
+
+static int init_cmds(void)
+{
+	char *tok, *saveptr;
+	int i;
+
+	for (tok = strtok_r(optarg, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+		for (i = 0; i < BENCH_CMD_MAX; i++) {
+			if (!strcmp(tok, bench_cmd_names[i])) {
+				bench_cmds[i] = true;
+				break;
+			}
+		}
+
+		if (i == BENCH_CMD_MAX) {
+			pr_err("Unknown command type %s\n", tok);
+			return ERROR;
+		}
+	}
+
+	return SUCCESS;
+}
+
+static int init_rates(char *list)
+{
+	char *tok, *saveptr, *end;
+	long rate;
+
+	bench_nr_rates = 0;
+	for (tok = strtok_r(list, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+		rate = strtol(tok, &end, 0);
+		if (*end != '\0' || rate <= 0 || rate > INT_MAX || bench_nr_rates >= BENCH_RATES_MAX) {
+			pr_err("Invalid or too many command rates %s\n", tok);
+			return ERROR;
+		}
+		bench_rates[bench_nr_rates++] = rate;
+	}
+
+	return SUCCESS;
+}
+
+static int parse_args(int argc, char *argv[])
+{
+	char rates[] = BENCH_RATES_DEFAULT;
+	int i, c = 0, ret = ERROR;
+	bool any_cmd = false;
+
+	if (argc < 2) {
+		pr_err("Too less args, try 'ufsbench -h'\n");
+		return ret;
+	}
+
+	if (!strcmp(argv[1], "--version")) {
+		printf("ufsbench version %s.\n", BENCH_VERSION);
+		return ret;
+	} else if (!strcmp(argv[1], "-h")) {
+		printf("%s\n", ufsbench_help);
+		return ret;
+	}
+
+	while (-1 != (c = getopt_long(argc, argv, ufsbench_short_options, ufsbench_long_options, &i))) {
+		switch (c) {
+		case 'f':
+			ret = init_device_path(target_path);
+			break;
+		case 'q':
+			ret = init_positive_value(&bench_qd, "queue depth");
+			break;
+		case 'b':
+			ret = init_positive_value(&bench_bs, "block size");
+			break;
+		case 'w':
+			ret = get_value_from_cli(&bench_write_pct);
+			if (ret || bench_write_pct > 100) {
+				pr_err("Invalid write percentage\n");
+				ret = ERROR;
+			}
+			break;
+		case 's':
+			ret = init_positive_value(&bench_size, "target size");
+			break;
+		case 't':
+			ret = init_positive_value(&bench_time, "step time");
+			break;
+		case 'c':
+			ret = init_cmds();
+			break;
+		case 'r':
+			ret = init_rates(optarg);
+			break;
+		case 'o':
+			ret = init_device_path(output_path);
+			break;
+		case 'd':
+			ret = init_device_path(device_path);
+			break;
+		case 1:
+			bench_force = true;
+			ret = SUCCESS;
+			break;
+		default:
+			pr_err("I cannot understand, please try 'ufsbench -h'.\n");
+			ret = ERROR;
+			break;
+		}
+
+		if (ret)
+			break;
+	}
+
+	if (ret)
+		return ret;
+
+	if (device_path[0] == '\0') {
+		pr_err("Path to bsg device not provided.\n");
+		return ERROR;
+	}
+
+	if (target_path[0] == '\0') {
+		pr_err("Foreground workload target not provided.\n");
+		return ERROR;
+	}
+
+	if (bench_qd > BENCH_QD_MAX) {
+		pr_err("Queue depth is limited to %d\n", BENCH_QD_MAX);
+		return ERROR;
+	}
+
+	if (bench_bs % BENCH_MEM_ALIGN_SIZE) {
+		pr_err("Block size must be a multiple of %d for O_DIRECT\n", BENCH_MEM_ALIGN_SIZE);
+		return ERROR;
+	}
+
+	for (i = 0; i < BENCH_CMD_MAX; i++)
+		any_cmd |= bench_cmds[i];
+	if (!any_cmd)
+		for (i = 0; i < BENCH_CMD_MAX; i++)
+			bench_cmds[i] = true;
+
+	if (!bench_nr_rates)
+		init_rates(rates);
+
+	return SUCCESS;
+}
+
+static int fill_target_file(__u64 size)
+{
+	char *buf;
+	__u64 off, seed = bench_now_ns();
+	unsigned int i;
+	int ret = SUCCESS;
+
+	buf = memalign(BENCH_MEM_ALIGN_SIZE, BENCH_FILL_CHUNK_SIZE);
+	if (!buf) {
+		pr_err("Failed to allocate memory for target file\n");
+		return ERROR;
+	}
+
+	for (i = 0; i < BENCH_FILL_CHUNK_SIZE / sizeof(__u64); i++)
+		((__u64 *)buf)[i] = fast_rand64(&seed);
+
+	/* Fully allocate the file so that reads do reach the device */
+	printf("Creating %llu MB target file...\n", (unsigned long long)(size >> 20));
+	for (off = 0; off < size; off += BENCH_FILL_CHUNK_SIZE) {
+		if (pwrite(target_fd, buf, BENCH_FILL_CHUNK_SIZE, off) != BENCH_FILL_CHUNK_SIZE) {
+			pr_err("Failed to write target file (%d)\n", errno);
+			ret = ERROR;
+			break;
+		}
+	}
+
+	fsync(target_fd);
+	free(buf);
+
+	return ret;
+}
+
+static int open_target(void)
+{
+	struct stat st;
+	__u64 size;
+	bool created;
+
+	/* An existing target may be written, resized or filled, it is only used with --force */
+	created = stat(target_path, &st) != 0;
+	if (!created && !bench_force) {
+		pr_err("Refusing to use existing %s without --force\n", target_path);
+		return ERROR;
+	}
+
+	target_fd = open(target_path, O_RDWR | O_DIRECT | (created ? O_CREAT | O_EXCL : 0), S_IWUSR | S_IRUSR);
+	if (target_fd < 0) {
+		pr_err("Failed to open %s (%d)\n", target_path, errno);
+		return ERROR;
+	}
+
+	if (!created && S_ISBLK(st.st_mode)) {
+		if (ioctl(target_fd, BLKGETSIZE64, &size)) {
+			pr_err("Failed to get size of %s\n", target_path);
+			return ERROR;
+		}
+	} else {
+		size = (__u64)bench_size << 20;
+		if (created || (__u64)st.st_size < size) {
+			if (fill_target_file(size))
+				return ERROR;
+		} else {
+			size = st.st_size;
+		}
+	}
+
+	target_blocks = size / bench_bs;
+	if (!target_blocks) {
+		pr_err("Target %s is smaller than one block\n", target_path);
+		return ERROR;
+	}
+
+	return SUCCESS;
+}
+
+static void init_bench_operation(void)
+{
+	bench_qd = BENCH_QD_DEFAULT;
+	bench_bs = BENCH_BS_DEFAULT;
+	bench_time = BENCH_TIME_DEFAULT;
+	bench_size = BENCH_SIZE_DEFAULT;
+	bsg_fd = INIT;
+	target_fd = INIT;
+
+	device_path[0] = '\0';
+	target_path[0] = '\0';
+	output_path[0] = '\0';
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_result base, res;
+	FILE *csv = NULL;
+	int i, t, r, ret;
+
+	init_bench_operation();
+
+	ret = parse_args(argc, argv);
+	if (ret)
+		return ret;
+
+	bsg_fd = open(device_path, O_RDWR);
+	if (bsg_fd < 0) {
+		pr_err("Failed to open file %s (%d).\n", device_path, bsg_fd);
+		return ERROR;
+	}
+
+	ret = open_target();
+	if (ret)
+		goto out;
+
+	for (i = 0; i < bench_qd; i++) {
+		workers[i].id = i;
+		workers[i].seed = bench_now_ns() + i;
+		workers[i].buf = memalign(BENCH_MEM_ALIGN_SIZE, bench_bs);
+		if (!workers[i].buf) {
+			pr_err("Failed to allocate memory for I/O\n");
+			ret = ERROR;
+			goto free_bufs;
+		}
+		memset(workers[i].buf, 0x5A, bench_bs);
+	}
+
+	if (output_path[0] != '\0') {
+		csv = fopen(output_path, "w");
+		if (!csv) {
+			pr_err("Failed to create %s\n", output_path);
+			ret = ERROR;
+			goto free_bufs;
+		}
+		fprintf(csv, "cmd,rate,achieved_rate,cmd_errors,io_errors,iops,mbps,p50_us,p99_us,p999_us,max_us,"
+			     "iops_change_pct,p99_change_pct,p999_change_pct\n");
+	}
+
+	printf("Foreground: %s, QD %d, bs %d, %d%% writes, %d s per step\n", target_path, bench_qd, bench_bs,
+	       bench_write_pct, bench_time);
+	printf("%-13s %6s %9s %7s %6s %9s %8s %8s %8s %9s %8s %8s %8s\n", "cmd", "rate", "achieved", "cmd_err",
+	       "io_err", "IOPS", "MB/s", "p50(us)", "p99(us)", "p99.9(us)", "IOPS%", "p99%", "p99.9%");
+
+	ret = bench_step(0, 0, &base);
+	if (ret)
+		goto close_csv;
+	print_result(&base, &base, csv);
+
+	for (t = 0; t < BENCH_CMD_MAX; t++) {
+		if (!bench_cmds[t])
+			continue;
+
+		for (r = 0; r < bench_nr_rates; r++) {
+			ret = bench_step(t, bench_rates[r], &res);
+			if (ret)
+				goto close_csv;
+			print_result(&res, &base, csv);
+		}
+	}
+
+close_csv:
+	if (csv) {
+		fclose(csv);
+		if (!ret)
+			printf("Results saved to %s\n", output_path);
+	}
+free_bufs:
+	for (i = 0; i < bench_qd; i++)
+		free(workers[i].buf);
+out:
+	if (target_fd >= 0)
+		close(target_fd);
+	close(bsg_fd);
+
+	return ret;
+}
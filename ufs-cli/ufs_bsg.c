@@ -9,6 +9,7 @@
 #include <sys/ioctl.h>
 #include "ufs_bsg.h"
 #include "lsufs.h"
+#include "throttle.h"
 
 int ufs_bsg_io(int fd, struct ufs_bsg_request *req, struct ufs_bsg_reply *reply,
 	       __u32 buf_len, __u8 *buf, enum bsg_ioctl_dir dir)
@@ -33,6 +34,8 @@ int ufs_bsg_io(int fd, struct ufs_bsg_request *req, struct ufs_bsg_reply *reply,
 	        sg_io.dout_xfer_len = buf_len;
 	}
 
+	throttle_wait();
+
 	ret = ioctl(fd, SG_IO, &sg_io);
 	if (ret)
 		pr_err("%s: Error from sg_io ioctl (return value: %d, error no: %d)",
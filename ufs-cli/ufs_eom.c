@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -20,9 +21,20 @@
 #include <errno.h>
 #include <unistd.h>
 #include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <linux/fs.h>
 #include "common.h"
 #include "query.h"
 #include "uic.h"
+#include "throttle.h"
+#include "eom_bin.h"
+#include "eom_uring.h"
+#include "eom_pattern.h"
+#include "eom_trace.h"
 
 #define EOM_VERSION  "1.0"
 
@@ -35,6 +47,89 @@
 #define EOM_TEMP_DATA_MEM_ALIGN_SIZE	4096
 #define EOM_SUPPORTED_MIN_GEAR		4
 #define EOM_TIMING_VOLTAGE_INIT		0xFF
+#define EOM_MAX_LANES			2
+/* Receivers measured at each point, the lanes of the host and the device with --both */
+#define EOM_MAX_RX			(EOM_MAX_LANES * 2)
+/* Background traffic threads with -D, each writing and reading its own EOM_TEMP_DATA_SIZE region */
+#define EOM_IO_THREADS_DEFAULT		2
+#define EOM_IO_THREADS_MAX		8
+/*
+ * io_uring stress engine defaults. Offsets, read/write mix and data pattern
+ * come from a fixed seed, so that every run issues the same I/O sequence.
+ */
+#define EOM_IO_QD_DEFAULT		32
+#define EOM_IO_QD_MAX			256
+#define EOM_IO_BS_DEFAULT		(128 * 1024)
+#define EOM_IO_WRITE_PCT_DEFAULT	50
+#define EOM_IO_FILE_SIZE		(64 * 1024 * 1024)
+#define EOM_IO_SEED			0x55465345
+#define EOM_UFS_UNIT_SIZE		512	/* Unit of the Geometry Descriptor sizes */
+#define EOM_UFS_MAX_LUN			31
+/* Longest wait for a due trace I/O, so that the traffic still pauses and stops promptly */
+#define EOM_IO_TRACE_WAIT_MAX_NS	1000000ULL
+/* Wait between two polls of the Eye Monitor while the traffic threads keep the link busy */
+#define EOM_POLL_INTERVAL_DEFAULT	1000	/* us */
+/* Polls without the measurement running before an incremental restart falls back to PMC */
+#define EOM_INCREMENTAL_START_POLLS	32
+
+/* eom_result flags, stored as is in binary reports */
+#define EOM_RESULT_MEASURED		EOM_BIN_MEASURED
+#define EOM_RESULT_INFERRED		EOM_BIN_INFERRED
+#define EOM_RESULT_CARRIED		EOM_BIN_CARRIED
+
+/* M-PHY eye mask, eye width in UI and half of the eye height in mV, as in ufs-eom-plot.py */
+#define EOM_MASK_G4_WIDTH_UI		0.48
+#define EOM_MASK_G4_HALF_HEIGHT_MV	40
+#define EOM_MASK_G5_WIDTH_UI		0.3
+#define EOM_MASK_G5_HALF_HEIGHT_MV	30
+#define EOM_MASK_SCALE_RESOLUTION	0.01
+/* HS-G1 bit rates in Mbps, doubling with each gear */
+#define EOM_HS_G1_RATE_A_MBPS		1248.0
+#define EOM_HS_G1_RATE_B_MBPS		1457.6
+
+/* Bathtub: target test counts measured, each level tests about half the UIs of the one above */
+#define EOM_BATHTUB_LEVELS		3
+#define EOM_BATHTUB_LEVEL_STEP		8
+#define EOM_BATHTUB_TARGET_BER		1e-12
+/* Transition density of random data, for the dual-Dirac model */
+#define EOM_BATHTUB_TRANSITION_DENSITY	0.5
+
+/* Scan planner: coarsest stride and lowest target test count it may pick */
+#define EOM_PLAN_MAX_STRIDE		4
+#define EOM_PLAN_MIN_TARGET		0x20
+/* Lowering the target test count by this much halves the UIs tested */
+#define EOM_PLAN_TARGET_STEP		8
+#define EOM_PLAN_CMD_SAMPLES		16
+
+/* Highest HS gear --sweep steps through */
+#define EOM_SWEEP_MAX_GEAR		6
+#define EOM_SWEEP_MAX_CONFIGS		((EOM_SWEEP_MAX_GEAR - EOM_SUPPORTED_MIN_GEAR + 1) * 2)
+
+/*
+ * Completion waits: the first poll is this far into the predicted completion
+ * time, then polls back off from the shortest to the longest interval, which
+ * is also at most this fraction of the last predicted completion time. New
+ * samples weigh this much in the learned completion times.
+ */
+#define EOM_WAIT_LEAD			0.95
+#define EOM_WAIT_MIN_US			50
+#define EOM_WAIT_MAX_US			5000
+#define EOM_WAIT_MAX_DIV		32
+#define EOM_WAIT_EWMA			0.125
+
+/* Points appended to the report between two fsync() by default */
+#define EOM_FSYNC_POINTS_DEFAULT	16
+
+/* Log2 histogram buckets of the phase durations in us, the last one is open ended */
+#define EOM_PHASE_BUCKETS		24
+/* A measurement this many times slower than the median so far is reported with -V */
+#define EOM_SLOW_POINT_FACTOR		4
+#define EOM_SLOW_POINT_MIN_SAMPLES	16
+
+/* Devices -d may give, scanned concurrently, and seconds between their progress lines */
+#define EOM_MAX_DEVICES			8
+#define EOM_DEVICES_PROGRESS_INTERVAL	10
+#define EOM_DEVICE_LOG			"ufseom.log"
 
 #define STRING_BUFFER_SIZE		0x24
 
@@ -43,6 +138,198 @@ struct eom_result {
 	int timing;
 	int volt;
 	int error_cnt;
+	int tested_cnt;
+	int target_cnt;
+	int flags;
+	int io_mbps;
+	int point_us;
+};
+
+struct eom_bathtub_sample {
+	int pos;
+	int target_cnt;
+	int error_cnt;
+	int tested_cnt;
+};
+
+/**
+ * struct eom_bathtub - Bathtub curve of one lane along the center row or column
+ * @line: Voltage of the row or timing of the column, EOM_TIMING_VOLTAGE_INIT if not measured
+ * @center: Position of the eye center on the line, which splits the two slopes
+ * @nr_samples: Number of entries in @samples
+ * @samples: Error counts along the line, at every bathtub level
+ * @fitted: Left/lower (0) and right/upper (1) slope could be fitted
+ * @mu: Slope position at Q = 0, in steps
+ * @sigma: Slope position change per unit of Q, in steps
+ * @edge: Slope position at EOM_BATHTUB_TARGET_BER, in steps
+ */
+struct eom_bathtub {
+	int line;
+	int center;
+	int nr_samples;
+	struct eom_bathtub_sample *samples;
+	bool fitted[2];
+	double mu[2];
+	double sigma[2];
+	double edge[2];
+};
+
+/**
+ * struct eom_eye - Eye metrics of one lane, from the scan results
+ * @open: The eye is open at timing @center voltage @mid, the other fields are only valid if it is
+ * @left: Leftmost open timing of the row through @mid, contiguous with the start timing
+ * @right: Rightmost open timing of that row
+ * @center: Eye center timing, as in ufs-eom-plot.py
+ * @mid: Voltage 0, or the nearest voltage of the scan range
+ * @low: Lowest open voltage of the center column, contiguous with @mid
+ * @high: Highest open voltage of the center column
+ * @area: Open points of the columns @left .. @right, contiguous with @mid
+ * @step_ui: Timing step in UI
+ * @step_mv: Voltage step in mV
+ * @scale: Largest passing eye mask scale
+ * @limited: The scan range, not a closed point, bounds @scale
+ */
+struct eom_eye {
+	bool open;
+	int left;
+	int right;
+	int center;
+	int mid;
+	int low;
+	int high;
+	int area;
+	double step_ui;
+	double step_mv;
+	double scale;
+	bool limited;
+};
+
+/**
+ * struct eom_wait_model - Completion times learned from the device, at one gear and rate
+ * @gear: Gear the model is for
+ * @rate: Rate series the model is for
+ * @ui_ns: UI period, which predicts @full_ns until it is learned
+ * @short_ns: Time for a lane to stop at the error threshold, 0 until learned
+ * @full_ns: Time for a lane to reach each target test count, 0 until learned
+ * @link_up_ns: Time for the link to come up after a PMC, 0 until learned
+ */
+struct eom_wait_model {
+	int gear;
+	int rate;
+	double ui_ns;
+	double short_ns;
+	double full_ns[EOM_TARGET_TEST_COUNT_MAX + 1];
+	double link_up_ns;
+};
+
+/**
+ * struct eom_plan - Scan planner model and plan
+ * @cmd_us: Average latency of one UIC command
+ * @short_s: Duration of a point on which every lane stops at the error threshold
+ * @long_s_per_ui: Additional duration per tested UI of a point that runs to the target test count
+ * @eye: The eye center of the lane is open, @left .. @high are its extents in steps
+ * @stride: Planned step stride
+ * @target_cnt: Planned target test count
+ * @num_lanes: Planned number of lanes
+ * @nr_points: Planned number of points
+ * @seconds: Predicted scan duration
+ */
+struct eom_plan {
+	double cmd_us;
+	double short_s;
+	double long_s_per_ui;
+	bool eye[EOM_MAX_LANES];
+	int left[EOM_MAX_LANES];
+	int right[EOM_MAX_LANES];
+	int low[EOM_MAX_LANES];
+	int high[EOM_MAX_LANES];
+
+	int stride;
+	int target_cnt;
+	int num_lanes;
+	int nr_points;
+	double seconds;
+};
+
+/**
+ * struct eom_point_stats - Error count statistics of one point over repeated sweeps
+ * @nr_sweeps: Number of sweeps the point was reported in
+ * @nr_fails: Number of those sweeps with errors
+ * @min: Lowest error count
+ * @max: Highest error count
+ * @mean: Running mean of the error count
+ * @m2: Running sum of squared differences from @mean (Welford)
+ */
+struct eom_point_stats {
+	int nr_sweeps;
+	int nr_fails;
+	int min;
+	int max;
+	double mean;
+	double m2;
+};
+
+/* Phases of a measurement, timed on the scan thread */
+enum eom_phase {
+	EOM_PHASE_CONFIG,	/* Eye Monitor attribute writes */
+	EOM_PHASE_PMC,		/* NO_ADAPT and PA_PWRMODE writes */
+	EOM_PHASE_LINK_UP,	/* Polling for the link to come back up after a PMC */
+	EOM_PHASE_IO_DRAIN,	/* Waiting for the stress I/O in flight before a PMC */
+	EOM_PHASE_POLL,		/* One iteration of RX_EYEMON_Start reads */
+	EOM_PHASE_COUNTERS,	/* RX_EYEMON_Tested_Count and Error_Count reads of a lane */
+	EOM_PHASE_POINT,	/* A whole measurement */
+	EOM_PHASE_MAX,
+};
+
+/**
+ * struct eom_phase_stats - Durations of one phase
+ * @count: Number of durations
+ * @total_ns: Sum of the durations
+ * @max_ns: Longest duration
+ * @buckets: Number of durations in [2^(i-1), 2^i) us, [0, 1) us for bucket 0
+ */
+struct eom_phase_stats {
+	unsigned long long count;
+	__u64 total_ns;
+	__u64 max_ns;
+	unsigned long long buckets[EOM_PHASE_BUCKETS];
+};
+
+enum eom_io_engine {
+	EOM_IO_SYNC,
+	EOM_IO_URING,
+};
+
+struct eom_io_worker {
+	pthread_t thread;
+	int id;
+	char *buf;
+	uint64_t seed;
+	unsigned int next;
+	unsigned long long ios;
+	int trace_pos;
+	__u64 trace_ns;
+	__u64 trace_loop_ns;
+};
+
+/**
+ * struct eom_config_result - Outcome of the scan at one gear and rate of --sweep
+ * @gear: HS gear
+ * @rate: PA_HS_MODE_A or PA_HS_MODE_B
+ * @status: SUCCESS, or the error of the Power Mode Change or the scan
+ * @mask_failed: The eye mask test failed on a lane
+ * @seconds: Duration of the scan
+ * @points: Number of points measured on all lanes
+ * @open: Number of points without errors per lane
+ */
+struct eom_config_result {
+	int gear;
+	int rate;
+	int status;
+	bool mask_failed;
+	long seconds;
+	int points;
+	int open[EOM_MAX_LANES];
 };
 
 struct EOMData {
@@ -56,11 +343,51 @@ struct EOMData {
 	int gear;
 	int rate;
 
+	/* Incremental scan state */
+	bool eom_armed;
+	int armed_target_cnt;
+	/* Counters right before RX_EYEMON_Start, cleared by re-enabling the Eye Monitor */
+	int start_tested_cnt[EOM_MAX_RX];
+	int start_error_cnt[EOM_MAX_RX];
+	/* Re-enabling the Eye Monitor does not clear its counters */
+	bool counters_kept;
+	int pmc_cnt;
+	int pmc_fallback_cnt;
+
+	/* Points filled in by the adaptive scan without being measured */
+	int inferred_cnt;
+	/* Points taken over from the seed report by a delta scan */
+	int carried_cnt;
+	/* Points re-measured at the full target test count after --quick-target */
+	int recount_cnt;
+
+	/* Point durations, split by whether any lane ran to the target test count */
+	__u64 long_ns;
+	__u64 short_ns;
+	int long_cnt;
+	int short_cnt;
+
+	/* Device Rx offset capabilities with --both, the step capabilities match the host's */
+	int peer_timing_max_offset;
+	int peer_voltage_max_offset;
+
+	/* Stress I/O throughput in MB/s while the last point was measured */
+	int io_mbps;
+
+	/* Duration of the last point and the slow ones among the points of the scan */
+	int point_us;
+	int slow_cnt;
+
+	/* Bathtub curves along the center row [0] and column [1] of each lane */
+	struct eom_bathtub bathtub[EOM_MAX_LANES][2];
+
 	struct eom_result *er;
 } eom_data;
 
 static char output_path[DEVICE_PATH_NAME_SIZE_MAX];
 static char device_path[DEVICE_PATH_NAME_SIZE_MAX];
+static char device_paths[EOM_MAX_DEVICES][DEVICE_PATH_NAME_SIZE_MAX];
+static int nr_devices;
 const static char *ufseom_tmp_file = "ufseom_tmp_data";
 static char *tmp_buf;
 
@@ -75,15 +402,99 @@ static int eom_result_count;
 static int tmp_fd, bsg_fd;
 static bool do_io;
 static bool verbose;
+static bool incremental;
+static int validate_stride;
+static bool adaptive;
+static int guard_band;
+static char seed_path[DEVICE_PATH_NAME_SIZE_MAX];
+/* Error counts of the seed report, indexed like eom_data.er, -1 if not in the report */
+static int *seed_err;
+static bool mask;
+static bool mask_margin;
+static int quick_target;
+static bool bathtub;
+static int budget;
+static bool dry_run;
+static int scan_stride = 1;
+static int fsync_points = EOM_FSYNC_POINTS_DEFAULT;
+static bool resume;
+static bool binary;
+static bool point_time;
+static struct eom_phase_stats eom_phases[EOM_PHASE_MAX];
+static const char *eom_phase_names[EOM_PHASE_MAX] = {
+	"config",
+	"pmc",
+	"link up",
+	"io drain",
+	"poll",
+	"counters",
+	"point",
+};
+static int repeat = 1;
+static int interval;
+static bool sweep_configs;
+static bool both;
+static int io_threads = EOM_IO_THREADS_DEFAULT;
+static int poll_interval = INIT;
+/* Poll at poll_interval as is, without the wait model */
+static bool fixed_poll;
+static struct eom_wait_model eom_wait;
+static enum eom_io_engine io_engine = EOM_IO_SYNC;
+static int io_qd = INIT;
+static int io_bs = INIT;
+static int io_write_pct = INIT;
+/* Offset and size alignment of the uring stress */
+static int io_align = EOM_TEMP_DATA_MEM_ALIGN_SIZE;
+static char io_target[DEVICE_PATH_NAME_SIZE_MAX];
+static bool io_force;
+static int io_pattern = EOM_PATTERN_RANDOM;
+/* Write data of the -D stress, filled once before the scan */
+static struct eom_pattern_pool io_pool;
+static char io_trace_path[DEVICE_PATH_NAME_SIZE_MAX];
+static bool io_trace_afap;
+/* I/Os the uring engine replays with --io-trace */
+static struct eom_trace io_trace;
+static __u64 io_blocks;
+static __u64 io_bytes;
+static struct eom_uring io_ring;
+/* Background traffic, paused while a PMC is in progress */
+static struct eom_io_worker io_workers[EOM_IO_THREADS_MAX];
+static int nr_io_workers;
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_cond = PTHREAD_COND_INITIALIZER;
+static bool io_stop;
+static bool io_paused;
+static bool io_read;
+static int io_busy;
+static int io_failed;
+/* Statistics of repeated sweeps, indexed like eom_data.er */
+static struct eom_point_stats *eom_stats;
+static char convert_path[DEVICE_PATH_NAME_SIZE_MAX];
+/* Reports the points are appended to while scanning, and their progress index, per side */
+static FILE *stream_file[2];
+static int stream_cnt[2];
+static int progress_fd[2];
+static char progress_file[2][1040];
+static __u64 stream_start_ns;
+/* Results the scan is going to record, the total of the progress index */
+static int progress_total;
+static char dev_mname[MANUFACTURER_NAME_STRING_DESC_SIZE];
+static char dev_pname[PRODUCT_NAME_STRING_DESC_SIZE];
+static char dev_pver[PRODUCT_REVISION_LEVEL_STRING_DESC_SIZE];
+static int cmd_rate;
+static int cmd_burst;
+static int qos_latency;
+static char qos_blk_devs[DEVICE_PATH_NAME_SIZE_MAX];
 
 const char *ufseom_help =
 	"\nufseom cli :\n\n"
-	"ufseom [-p | --peer | -l | --local] [-D | --data] [-L | --lane <lane no.>] [--voltage-low <low voltage value>] [--voltage-high <high voltage value>] [--timing-left <left timing value>] [--timing-right <right timing value>] [-T | --target <target test count>] [-o | --output <output>] [-d | --device <device>]\n\n"
+	"ufseom [-p | --peer | -l | --local] [-D | --data] [-L | --lane <lane no.>] [--voltage-low <low voltage value>] [--voltage-high <high voltage value>] [--timing-left <left timing value>] [--timing-right <right timing value>] [-T | --target <target test count>] [-o | --output <output>] [-d | --device <device>]... [--incremental] [--validate <stride>] [--adaptive] [--seed <report>] [--guard <steps>] [--mask] [--margin] [--quick-target <target test count>] [--bathtub] [--budget <seconds>] [--dry-run] [--fsync <points>] [--resume] [--binary] [--repeat <sweeps>] [--interval <seconds>] [--sweep] [--both] [--io-threads <threads>] [--poll-interval <us>] [--fixed-poll] [--io-engine <sync|uring>] [--io-qd <depth>] [--io-bs <bytes>] [--io-write <percent>] [--io-target <path>] [--io-force] [--pattern <pattern>] [--io-trace <trace>] [--io-trace-afap] [--point-time] [--rate <commands/s>] [--burst <commands>] [--qos-blk <block devices>] [--qos-latency <us>]\n\n"
 	"-h : help\n"
 	"--version : UFS EOM version\n"
 	"-p | --peer : peer\n"
 	"-l | --local : local\n"
-	"-D | --data : explicitly do I/O transfer with random data patterns to stress the link while EOM is running\n"
+	"-D | --data : explicitly do I/O transfer with random data patterns to stress the link while EOM is running,\n"
+	"             from background threads which pause during Power Mode Changes\n"
 	"-L | --lane : lane no. 0 or 1, collect EOM data for all connected lanes if not given\n"
 	"--voltage-low : collect EOM data from low voltage to high voltage, if it is not given, it defaults to -voltage_max_steps\n"
 	"--voltage-high : collect EOM data from low voltage to high voltage, if it is not given, it defaults to voltage_max_steps\n"
@@ -92,7 +503,77 @@ const char *ufseom_help =
 	"-t | --target : target test count\n"
 	"-o | --output : path to the folder where the EOM report is saved\n"
 	"-V | --verbose : enable detailed EOM information and logs\n"
-	"-d | --device : path to ufs-bsg device\n\n"
+	"-d | --device : path to ufs-bsg device, may be given up to 8 times to scan several devices at once, each\n"
+	"                in its own process with its reports and log (ufseom.log) in <output>/<bsg node name>/\n"
+	"--incremental : apply Eye Monitor enable and NO_ADAPT with one PMC per lane, then only update timing/voltage\n"
+	"                steps, clear the counters by re-enabling the Eye Monitor and restart EOM via RX_EYEMON_Start for\n"
+	"                each point, a PMC is only done if EOM does not restart\n"
+	"--validate : after an incremental scan, re-measure every <stride>-th point in full PMC mode and compare results\n"
+	"--adaptive : start from the eye center and trace the eye contour, find the open/closed boundary of each row\n"
+	"             and column by bisection and only measure points near it, the others are reported as inferred\n"
+	"--seed : rescan only the boundary band of the eye in a previous .eom report of the same lane(s) and gear,\n"
+	"         expanding outwards where results changed, the other points are carried over from the report\n"
+	"--guard : with --adaptive, also measure <steps> points on both sides of each boundary, defaults to 0,\n"
+	"          with --seed, width of the boundary band, defaults to 1\n"
+	"--mask : only measure the outline of the M-PHY eye mask (0.48 UI/80 mV for HS-G4, 0.3 UI/60 mV for HS-G5)\n"
+	"         around the eye center of each lane and report pass/fail, exits with an error if a lane fails\n"
+	"--margin : with --mask, also search the largest mask scale that still passes and report the margin\n"
+	"--quick-target : measure each point with this lower target test count first, and only re-measure points\n"
+	"                 with an error count between 0 and the threshold, or open next to errors, at the target\n"
+	"                 test count. The count used is reported per point\n"
+	"--bathtub : only measure the center row and column of the eye, at the target test count and two lower\n"
+	"            counts, fit the bathtub curves with a dual-Dirac model and extrapolate the eye width and\n"
+	"            height at BER 1e-12, which are added to the report\n"
+	"--budget : measure command and point durations on a few calibration points around the eye center, then\n"
+	"           pick the step stride (up to 4), target test count (down to 32) and lanes so that the scan is\n"
+	"           predicted to end within <seconds>. Points skipped by the stride are reported as inferred\n"
+	"--dry-run : only run the calibration and print the predicted duration and plan, without scanning\n"
+	"--fsync : points are appended to the report as they are measured, sync it to storage every <points>\n"
+	"          points, defaults to 16, 0 to only sync at the end of the scan\n"
+	"--resume : take over the points of the report an interrupted scan with the same options left in the\n"
+	"           output folder and only measure the others. Progress is kept in <report>.progress\n"
+	"--binary : also save the report in the binary format, <report>b (e.g. local_lane_0_gear_4_ttc_93.eomb)\n"
+	"--repeat : run the scan <sweeps> times and report the highest error count of every point, along\n"
+	"           with its min, max, mean, variance and fraction of failing sweeps in Repeat sections\n"
+	"--interval : with --repeat, wait <seconds> between sweeps, defaults to 0\n"
+	"--sweep : scan at every HS gear from HS-G4 up to the highest one both sides support, in Rate-A and\n"
+	"          Rate-B, via PA_PWRMode. Saves one report per gear and rate (named with the rate) and a\n"
+	"          summary, then restores the original power mode\n"
+	"--both : measure the host (local) and device (peer) Rx at the same time, sharing every PMC and I/O,\n"
+	"         and save a local and a peer report. -p and -l are not needed. Full grid scans only\n"
+	"--io-threads : number of -D traffic threads, each with its own 4MB region of the temporary file,\n"
+	"               defaults to 2, up to 8\n"
+	"--poll-interval : wait at least <us> between two polls of the Eye Monitor and link status, defaults to 1000\n"
+	"                  with -D and to 0 (no wait) without. Polls start shortly before the completion predicted\n"
+	"                  from what the device took so far, then back off exponentially\n"
+	"--fixed-poll : poll every --poll-interval us, back to back by default without -D, instead of predicting\n"
+	"               completions\n"
+	"--io-engine : -D stress engine, sync (default, 4MB write and read back per thread) or uring\n"
+	"              (random I/Os through io_uring with registered buffers and a fixed file)\n"
+	"--io-qd : uring queue depth up to 256, defaults to the device queue depth (bQueueDepth, or bLUQueueDepth\n"
+	"          of the target LU), 32 if it is not reported\n"
+	"--io-bs : uring block size in bytes, a multiple of 4096 up to 4MB, defaults to 131072 or more, as\n"
+	"          the optimal block and buffer sizes of the Geometry Descriptor call for\n"
+	"--io-write : percentage of uring writes, defaults to 50\n"
+	"--io-target : file or block device (LU or partition) to stress, defaults to a temporary file in\n"
+	"              the output folder (64MB with uring)\n"
+	"--io-force : allow writes when the -D target is a block device, its content is destroyed\n"
+	"--pattern : data written by -D, random (default), prbs7, prbs15, prbs31, cjtpat, alt (0xAA),\n"
+	"            low (32 zeros, 32 ones) or rotate (each pattern in turn)\n"
+	"--io-trace : replay a block I/O trace with --io-engine uring, in a loop and in real time, instead of\n"
+	"             random I/Os. Either blkparse text output or CSV lines of <offset>,<size>,<R|W>,<seconds>.\n"
+	"             Offsets wrap around the -D target, --io-qd limits the I/Os in flight\n"
+	"--io-trace-afap : replay the --io-trace I/Os as fast as possible, without the gaps between them\n"
+	"--point-time : add the time in us it took to measure each point to the report\n"
+	"--convert : convert a text .eom report to a binary .eomb report or back, next to the given report,\n"
+	"            and exit. No other option applies\n"
+	"--rate : limit UIC and Query commands to <commands/s>, not limited if not given\n"
+	"--burst : number of commands allowed back to back under --rate, defaults to 1\n"
+	"--qos-blk : comma separated block devices (e.g. sda,sdb) whose I/O latency in /sys/block/<dev>/stat\n"
+	"            throttles commands further when it rises, requires --rate. Not with -D, whose own stress I/O\n"
+	"            would drive the rate down\n"
+	"--qos-latency : average I/O latency target in us for --qos-blk, if it is not given, it defaults to\n"
+	"                twice the best latency observed during the scan\n\n"
 	"Example:\n"
 	"  1. Collect EOM data for local Rx:\n"
 	"  ufseom -l -D -o /data/ -d /dev/ufs-bsg0\n"
@@ -103,7 +584,45 @@ const char *ufseom_help =
 	"  4. Collect EOM data for local Rx from voltage 0 to 8:\n"
 	"  ufseom -l -D --voltage-low 0 --voltage-high 8 -o /data/ -d /dev/ufs-bsg0\n"
 	"  5. Collect EOM data for local Rx for voltage from 0 to 8 and timing from -1 to 1:\n"
-	"  ufseom -l -D --voltage-low 0 --voltage-high 8 --timing-left -1 --timing-right 1 -o /data/ -d /dev/ufs-bsg0\n\n"
+	"  ufseom -l -D --voltage-low 0 --voltage-high 8 --timing-left -1 --timing-right 1 -o /data/ -d /dev/ufs-bsg0\n"
+	"  6. Collect EOM data for local Rx in incremental mode, cross-checking every 10th point with full PMC mode:\n"
+	"  ufseom -l -D --incremental --validate 10 -o /data/ -d /dev/ufs-bsg0\n"
+	"  7. Collect EOM data for peer Rx on a serving machine, at most 200 commands/s, backing off on sda latency:\n"
+	"  ufseom -p --rate 200 --qos-blk sda -o /data/ -d /dev/ufs-bsg0\n"
+	"  8. Collect EOM data for local Rx along the eye contour, measuring 2 points around the boundaries:\n"
+	"  ufseom -l -D --incremental --adaptive --guard 2 -o /data/ -d /dev/ufs-bsg0\n"
+	"  9. Re-qualify local Rx after a firmware update, starting from the previous report:\n"
+	"  ufseom -l -D --incremental --seed /data/local_lane_0_1_gear_4_ttc_93.eom -o /data/new/ -d /dev/ufs-bsg0\n"
+	"  10. Screen peer Rx against the eye mask and report the margin of each lane:\n"
+	"  ufseom -p -D --incremental --mask --margin -o /data/ -d /dev/ufs-bsg0\n"
+	"  11. Collect EOM data for local Rx, running the full target test count only around the eye boundary:\n"
+	"  ufseom -l -D --incremental --quick-target 16 -t 127 -o /data/ -d /dev/ufs-bsg0\n"
+	"  12. Estimate the local Rx eye width and height at BER 1e-12 from bathtub curves:\n"
+	"  ufseom -l -D --incremental --bathtub -t 127 -o /data/ -d /dev/ufs-bsg0\n"
+	"  13. Print how long a full scan of local Rx would take and what fits in 10 minutes:\n"
+	"  ufseom -l -D --incremental --budget 600 --dry-run -o /data/ -d /dev/ufs-bsg0\n"
+	"  14. Continue an interrupted scan of local Rx, syncing the report after every point:\n"
+	"  ufseom -l -D --incremental --resume --fsync 1 -o /data/ -d /dev/ufs-bsg0\n"
+	"  15. Convert a binary report back to text for ufs-eom-plot.py:\n"
+	"  ufseom --convert /data/local_lane_0_1_gear_4_ttc_93.eomb\n"
+	"  16. Collect local Rx EOM statistics over 10 sweeps, one minute apart:\n"
+	"  ufseom -l -D --incremental --repeat 10 --interval 60 -o /data/ -d /dev/ufs-bsg0\n"
+	"  17. Collect EOM data for peer Rx at every supported gear and rate series:\n"
+	"  ufseom -p -D --incremental --sweep -o /data/ -d /dev/ufs-bsg0\n"
+	"  18. Collect EOM data for local and peer Rx in one scan:\n"
+	"  ufseom -D --incremental --both -o /data/ -d /dev/ufs-bsg0\n"
+	"  19. Collect EOM data for local Rx with 4 traffic threads, polling every 500us:\n"
+	"  ufseom -l -D --io-threads 4 --poll-interval 500 -o /data/ -d /dev/ufs-bsg0\n"
+	"  20. Collect EOM data for local Rx, stressed by random 64KB reads at QD 64 on a LU:\n"
+	"  ufseom -l -D --io-engine uring --io-qd 64 --io-bs 65536 --io-write 0 --io-target /dev/sdb -o /data/ -d /dev/ufs-bsg0\n"
+	"  21. Collect EOM data for peer Rx, stressed by writes of PRBS31 data:\n"
+	"  ufseom -p -D --io-engine uring --io-write 100 --pattern prbs31 -o /data/ -d /dev/ufs-bsg0\n"
+	"  22. Collect EOM data for local Rx while replaying a production I/O trace on a scratch LU:\n"
+	"  ufseom -l -D --io-engine uring --io-trace /data/sda.blkparse --io-target /dev/sdc --io-force -o /data/ -d /dev/ufs-bsg0\n"
+	"  23. Collect EOM data for local Rx with the time of each point, and the phase histograms:\n"
+	"  ufseom -l -D --point-time -V -o /data/ -d /dev/ufs-bsg0\n"
+	"  24. Collect EOM data for local Rx of two UFS hosts at once, into /data/ufs-bsg0/ and /data/ufs-bsg1/:\n"
+	"  ufseom -l -D --incremental -o /data/ -d /dev/ufs-bsg0 -d /dev/ufs-bsg1\n\n"
 	"Note that to get accurate EOM data, user should disable UFS driver low power mode features,\n"
 	"such as Clock Scaling, Clock Gating, Suspend/Resume and Auto Hibernate. For example:\n"
 	"$ echo 0 > /sys/devices/<path to platform devices>/*.ufshc/clkscale_enable\n"
@@ -128,6 +647,42 @@ static struct option ufseom_long_options[] = {
 	{"voltage-high", required_argument, NULL, 2}, /* Voltage high */
 	{"timing-left", required_argument, NULL, 3}, /* Timing left*/
 	{"timing-right", required_argument, NULL, 4}, /* Timing right */
+	{"rate", required_argument, NULL, 5}, /* UIC/Query command rate budget */
+	{"burst", required_argument, NULL, 6}, /* UIC/Query command burst */
+	{"qos-blk", required_argument, NULL, 7}, /* Block devices for latency feedback */
+	{"qos-latency", required_argument, NULL, 8}, /* Latency target for feedback */
+	{"incremental", no_argument, NULL, 9}, /* Restart EOM without PMC per point */
+	{"validate", required_argument, NULL, 10}, /* Compare incremental results with full PMC mode */
+	{"adaptive", no_argument, NULL, 11}, /* Trace the eye contour instead of a full grid */
+	{"guard", required_argument, NULL, 12}, /* Guard band around the contour */
+	{"seed", required_argument, NULL, 13}, /* Previous report for a delta scan */
+	{"mask", no_argument, NULL, 14}, /* Eye mask pass/fail */
+	{"margin", no_argument, NULL, 15}, /* Eye mask margin search */
+	{"quick-target", required_argument, NULL, 16}, /* First pass target test count */
+	{"bathtub", no_argument, NULL, 17}, /* Bathtub curves and BER extrapolation */
+	{"budget", required_argument, NULL, 18}, /* Scan time budget */
+	{"dry-run", no_argument, NULL, 19}, /* Print the scan plan only */
+	{"fsync", required_argument, NULL, 20}, /* Report sync interval in points */
+	{"resume", no_argument, NULL, 21}, /* Resume an interrupted report */
+	{"binary", no_argument, NULL, 22}, /* Binary report */
+	{"convert", required_argument, NULL, 23}, /* Convert between text and binary reports */
+	{"repeat", required_argument, NULL, 24}, /* Number of sweeps */
+	{"interval", required_argument, NULL, 25}, /* Wait between sweeps */
+	{"sweep", no_argument, NULL, 26}, /* Scan at every gear and rate */
+	{"both", no_argument, NULL, 27}, /* Local and peer Rx at once */
+	{"io-threads", required_argument, NULL, 28}, /* Background traffic threads */
+	{"poll-interval", required_argument, NULL, 29}, /* Wait between polls */
+	{"io-engine", required_argument, NULL, 30}, /* Stress engine */
+	{"io-qd", required_argument, NULL, 31}, /* Stress queue depth */
+	{"io-bs", required_argument, NULL, 32}, /* Stress block size */
+	{"io-write", required_argument, NULL, 33}, /* Stress write percentage */
+	{"io-target", required_argument, NULL, 34}, /* Stress file or block device */
+	{"io-force", no_argument, NULL, 35}, /* Allow writes to a block device */
+	{"pattern", required_argument, NULL, 36}, /* Stress data pattern */
+	{"io-trace", required_argument, NULL, 37}, /* Replay a block I/O trace */
+	{"io-trace-afap", no_argument, NULL, 38}, /* Replay without the trace timing */
+	{"point-time", no_argument, NULL, 39}, /* Per-point timing column */
+	{"fixed-poll", no_argument, NULL, 40}, /* Poll without the wait model */
 	{NULL, 0, NULL, 0}
 };
 
@@ -141,20 +696,6 @@ static uint64_t fast_rand64(uint64_t *seed)
 	return val & 0x7FFFFFFFFFFFFFFFLL;
 }
 
-static void populate_data_pattern(char *buffer)
-{
-	unsigned int i, val;
-	unsigned int size = EOM_TEMP_DATA_SIZE / sizeof(int);
-	uint64_t seed = rand();
-	int *buf = (int *)buffer;
-
-	for (i = 0; i < size; i++) {
-		val = (fast_rand64(&seed) & 0xFFFFFFFF);
-		*buf = val;
-		buf++;
-	}
-}
-
 static int parse_string_desc(__u8 *buf, char *string)
 {
 	int len, i, j;
@@ -239,268 +780,3402 @@ int get_device_info(char *mname, char *pname, char *pversion)
 	return SUCCESS;
 }
 
-static int config_eom(int peer, int lane, int timing, int volt, int target_count)
+static __u64 eom_now_ns(void)
 {
-	int ret;
+	struct timespec ts;
 
-	/* Enable Eye Monitor */
-	ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_ENABLE, SELECT_RX(lane)), ATTR_SET_NOR, 1, peer);
-	if (ret) {
-		pr_err("Failed to set RX_EYEMON_Enable\n");
-		return ret;
-	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	/* Config Eye Monitor timing steps */
-	ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_TIMING_STEPS, SELECT_RX(lane)), ATTR_SET_NOR, timing, peer);
-	if (ret) {
-		pr_err("Failed to set RX_EYEMON_Timing_Steps\n");
-		return ret;
-	}
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-	/* Config Eye Monitor voltage steps */
-	ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_VOLTAGE_STEPS, SELECT_RX(lane)), ATTR_SET_NOR, volt, peer);
-	if (ret) {
-		pr_err("Failed to set RX_EYEMON_Voltage_Steps\n");
-		return ret;
-	}
+/* Account the time since @start_ns to @phase, returns the duration */
+static __u64 eom_phase_add(int phase, __u64 start_ns)
+{
+	struct eom_phase_stats *ps = &eom_phases[phase];
+	__u64 ns = eom_now_ns() - start_ns, us = ns / 1000;
+	int b = us ? 64 - __builtin_clzll(us) : 0;
 
-	/* Config Eye Monitor target test count */
-	ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_TARGET_TEST_COUNT, SELECT_RX(lane)),
-				ATTR_SET_NOR, target_count, peer);
-	if (ret) {
-		pr_err("Failed to set RX_EYEMON_Target_Test_Count\n");
-		return ret;
-	}
+	ps->count++;
+	ps->total_ns += ns;
+	if (ns > ps->max_ns)
+		ps->max_ns = ns;
+	ps->buckets[b < EOM_PHASE_BUCKETS ? b : EOM_PHASE_BUCKETS - 1]++;
 
-	/* Select NO_ADAPT */
-	ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(PA_TXHSADAPTTYPE, SELECT_TX(0)), ATTR_SET_NOR, PA_NO_ADAPT, 0);
-	if (ret) {
-		pr_err("Failed to set NO_ADAPT\n");
-		return ret;
-	}
+	return ns;
+}
 
-	/* Do a Power Mode Change to Fast Mode to apply NO_ADAPT and also trigger a RCT to kick start EOM */
-	ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(PA_PWRMODE, SELECT_TX(0)), ATTR_SET_NOR, 0x11, 0);
-	if (ret) {
-		pr_err("Failed to trigger RCT\n");
-		return ret;
-	}
+/* Upper bound in us of the bucket holding the @pct percentile of @phase, at most the maximum */
+static __u64 eom_phase_percentile(int phase, int pct)
+{
+	struct eom_phase_stats *ps = &eom_phases[phase];
+	unsigned long long at = (ps->count * pct + 99) / 100, acc = 0;
+	int b;
 
-	/* Poll UniPro State to confirm PMC is done. */
-	while (1) {
-		ret = uic_get(bsg_fd, UIC_ARG_MIB_SEL(QCOM_DME_VS_UNIPRO_STATE, SELECT_TX(0)), 0);
-		if (ret < 0) {
-			/* Failed to get QCOM_DME_VS_UNIPRO_STATE, maybe not supported? */
+	for (b = 0; b < EOM_PHASE_BUCKETS - 1; b++) {
+		acc += ps->buckets[b];
+		if (acc >= at)
 			break;
-		} else if ((ret & QCOM_DME_VS_UNIPRO_STATE_MASK) == QCOM_DME_VS_UNIPRO_STATE_LINK_UP) {
-			break;
-		}
 	}
 
-	/* QCOM_DME_VS_UNIPRO_STATE not supported? Delay a bit to make sure PMC is completed */
-	if (ret < 0)
-		usleep(200000);
+	return (1ULL << b) < ps->max_ns / 1000 ? 1ULL << b : ps->max_ns / 1000;
+}
 
-	return SUCCESS;
+static void eom_phase_reset(void)
+{
+	memset(eom_phases, 0, sizeof(eom_phases));
+	eom_data.slow_cnt = 0;
 }
 
-static int eom_scan(int peer, int lane, int timing, int volt, int target_count)
+/*
+ * Print the time spent in each phase of the scan, percentiles are bucket
+ * upper bounds. With -V, also print the histograms.
+ */
+static void eom_phase_report(void)
 {
-	struct EOMData *data = &eom_data;
-	int voltage_direction, timing_direction;
-	int voltage_steps, timing_steps;
-	int eom_start, eom_tested_count, eom_error_count;
-	int ret;
+	struct eom_phase_stats *ps;
+	unsigned long long peak;
+	int p, b, first, last;
+
+	printf("Phase timing:\n");
+	printf("%-10s %10s %10s %10s %10s %10s %10s\n", "phase", "count", "total s", "mean us", "p50 us", "p99 us",
+	       "max us");
+	for (p = 0; p < EOM_PHASE_MAX; p++) {
+		ps = &eom_phases[p];
+		if (!ps->count)
+			continue;
+		printf("%-10s %10llu %10.3f %10llu %10llu %10llu %10llu\n", eom_phase_names[p], ps->count,
+		       ps->total_ns / 1e9, (unsigned long long)(ps->total_ns / ps->count / 1000),
+		       (unsigned long long)eom_phase_percentile(p, 50), (unsigned long long)eom_phase_percentile(p, 99),
+		       (unsigned long long)(ps->max_ns / 1000));
+	}
+	if (eom_data.slow_cnt)
+		printf("%d measurements took more than %d times the median\n", eom_data.slow_cnt, EOM_SLOW_POINT_FACTOR);
+
+	if (!verbose)
+		return;
+
+	for (p = 0; p < EOM_PHASE_MAX; p++) {
+		ps = &eom_phases[p];
+		if (!ps->count)
+			continue;
+
+		first = EOM_PHASE_BUCKETS;
+		last = 0;
+		peak = 0;
+		for (b = 0; b < EOM_PHASE_BUCKETS; b++) {
+			if (!ps->buckets[b])
+				continue;
+			first = b < first ? b : first;
+			last = b;
+			peak = ps->buckets[b] > peak ? ps->buckets[b] : peak;
+		}
 
-	if (volt < 0) {
-		voltage_direction = 1;
-		voltage_steps = (voltage_direction << EOM_DIRECTION_SHIFT) | (-volt & EOM_STEP_MASK);
-	} else {
-		voltage_direction = 0;
-		voltage_steps = (voltage_direction << EOM_DIRECTION_SHIFT) | (volt & EOM_STEP_MASK);
+		printf("Phase histogram: %s\n", eom_phase_names[p]);
+		for (b = first; b <= last; b++)
+			printf("  < %10llu us %10llu %.*s\n", 1ULL << b, ps->buckets[b], (int)(ps->buckets[b] * 40 / peak),
+			       "########################################");
 	}
+}
 
-	if (timing < 0) {
-		timing_direction = 1;
-		timing_steps = (timing_direction << EOM_DIRECTION_SHIFT) | (-timing & EOM_STEP_MASK);
-	} else {
-		timing_direction = 0;
-		timing_steps = (timing_direction << EOM_DIRECTION_SHIFT) | (timing & EOM_STEP_MASK);
+/*
+ * RX_EYEMON_Tested_Count is taken as a 3-bit mantissa M and a 4-bit
+ * exponent E, (8 + M) << E UIs. Only the absolute BER scale depends on it.
+ */
+static double eom_tested_uis(int count)
+{
+	return (double)(8 + (count & 0x7)) * (1ULL << (count >> 3));
+}
+
+static double eom_ui_ps(struct EOMData *data)
+{
+	double mbps = data->rate == PA_HS_MODE_A ? EOM_HS_G1_RATE_A_MBPS : EOM_HS_G1_RATE_B_MBPS;
+
+	return 1e6 / (mbps * (1 << (data->gear - 1)));
+}
+
+/* Model of the current gear and rate, what was learned at another one does not apply */
+static struct eom_wait_model *eom_wait_model(void)
+{
+	struct eom_wait_model *wm = &eom_wait;
+
+	if (wm->gear != eom_data.gear || wm->rate != eom_data.rate) {
+		memset(wm, 0, sizeof(*wm));
+		wm->gear = eom_data.gear;
+		wm->rate = eom_data.rate;
+		wm->ui_ns = eom_data.gear > 0 ? eom_ui_ps(&eom_data) / 1000 : 0;
 	}
 
-	ret = config_eom(peer, lane, timing_steps, voltage_steps, target_count);
-	if (ret) {
-		pr_err("Failed to configure EOM.\n");
-		return ret;
+	return wm;
+}
+
+/*
+ * A completion is only seen at the first poll after it, so it is learned as
+ * the middle of the last poll before it (@before_ns) and that poll (@seen_ns).
+ * A prediction too late lets the first poll see it done and halves it.
+ */
+static void eom_wait_learn(double *est_ns, __u64 before_ns, __u64 seen_ns)
+{
+	double ns = (before_ns + seen_ns) / 2.0;
+
+	*est_ns = *est_ns ? *est_ns + (ns - *est_ns) * EOM_WAIT_EWMA : ns;
+}
+
+/*
+ * Predicted time for a lane to reach @target_count, from the nearest target
+ * test count learned, scaled by the UIs to test, or from the UI period.
+ */
+static double eom_wait_full_ns(struct eom_wait_model *wm, int target_count)
+{
+	int d, t;
+
+	for (d = 0; d <= EOM_TARGET_TEST_COUNT_MAX; d++) {
+		t = target_count - d;
+		if (t < 0 || !wm->full_ns[t])
+			t = target_count + d;
+		if (t > EOM_TARGET_TEST_COUNT_MAX || !wm->full_ns[t])
+			continue;
+
+		return wm->full_ns[t] * eom_tested_uis(target_count) / eom_tested_uis(t);
 	}
 
-repeat_eom_scan:
-	if (!do_io)
-		goto skip_io;
+	return eom_tested_uis(target_count) * wm->ui_ns;
+}
 
-	/* Write to excercise peer device's Rx */
-	populate_data_pattern(tmp_buf);
-	ret = pwrite(tmp_fd, tmp_buf, EOM_TEMP_DATA_SIZE, 0);
-	if (ret < 0) {
-		pr_err("Failed to write tmp file\n");
-		return ERROR;
+/**
+ * eom_wait_next - Sleep until the next poll of a wait
+ * @start_ns: Start of the wait
+ * @expect_ns: Predicted completion times since @start_ns, in ascending order
+ * @nr_expect: Number of entries in @expect_ns, 0 to poll every poll_interval as --fixed-poll does
+ * @backoff_us: Backoff interval, 0 before the first poll
+ *
+ * The first poll is shortly before the first predicted completion. Then the
+ * interval doubles after each poll, up to EOM_WAIT_MAX_US and a fraction of
+ * the last predicted completion time, but never goes past the next predicted
+ * completion, where it starts over.
+ */
+static void eom_wait_next(__u64 start_ns, const double *expect_ns, int nr_expect, __u64 *backoff_us)
+{
+	__u64 min_us = poll_interval > EOM_WAIT_MIN_US ? poll_interval : EOM_WAIT_MIN_US, max_us;
+	double elapsed = eom_now_ns() - start_ns, next = 0;
+	__u64 us;
+	int i;
+
+	if (fixed_poll || !nr_expect) {
+		if (poll_interval)
+			usleep(poll_interval);
+		return;
 	}
 
-	if (peer == LOCAL) {
-		/* Read to excercise local device's Rx */
-		ret = pread(tmp_fd, tmp_buf, EOM_TEMP_DATA_SIZE, 0);
-		if (ret < 0){
-			pr_err("Failed to read tmp file\n");
-			return ERROR;
-		}
+	max_us = expect_ns[nr_expect - 1] / 1000 / EOM_WAIT_MAX_DIV;
+	if (max_us > EOM_WAIT_MAX_US)
+		max_us = EOM_WAIT_MAX_US;
+	if (max_us < min_us)
+		max_us = min_us;
+
+	for (i = 0; i < nr_expect && !next; i++) {
+		if (expect_ns[i] * EOM_WAIT_LEAD > elapsed)
+			next = expect_ns[i] * EOM_WAIT_LEAD - elapsed;
 	}
 
-skip_io:
-	/* Get RX_EYEMON_Start */
-	eom_start = uic_get(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_START, SELECT_RX(lane)), peer);
-	if (eom_start < 0) {
-		pr_err("Failed to get RX_EYEMON_Start, eom_start = %d\n", eom_start);
-		return ERROR;
+	if (!*backoff_us) {
+		*backoff_us = min_us;
+		us = next / 1000;
+	} else if (next && next / 1000 <= *backoff_us) {
+		us = next / 1000;
+		*backoff_us = min_us;
+	} else {
+		us = *backoff_us;
+		*backoff_us = us * 2 < max_us ? us * 2 : max_us;
 	}
 
-	/* EOM has not yet stopped */
-	if (eom_start & RX_EYEMON_START_MASK)
-		goto repeat_eom_scan;
+	if (us)
+		usleep(us);
+}
 
-	/* Get RX_EYEMON_Tested_Count */
-	eom_tested_count = uic_get(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_TESTED_COUNT, SELECT_RX(lane)), peer);
-	if (eom_tested_count < 0) {
-		pr_err("Failed to get RX_EYEMON_Tested_Count\n");
-		return ERROR;
+/* What the wait model learned, with -V */
+static void eom_wait_report(void)
+{
+	struct eom_wait_model *wm = eom_wait_model();
+	int t;
+
+	printf("Wait model: link up %.0f us, error threshold %.0f us", wm->link_up_ns / 1000, wm->short_ns / 1000);
+	for (t = 0; t <= EOM_TARGET_TEST_COUNT_MAX; t++) {
+		if (wm->full_ns[t])
+			printf(", target test count %d %.0f us", t, wm->full_ns[t] / 1000);
 	}
+	printf("\n");
+}
 
-	/* Get RX_EYEMON_Error_Count */
-	eom_error_count = uic_get(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_ERROR_COUNT, SELECT_RX(lane)), peer);
-	if (eom_error_count < 0) {
-		pr_err("Failed to get RX_EYEMON_Error_Count\n");
-		return ERROR;
+static int eom_steps(int val)
+{
+	int direction = val < 0 ? 1 : 0;
+
+	return (direction << EOM_DIRECTION_SHIFT) | ((val < 0 ? -val : val) & EOM_STEP_MASK);
+}
+
+/*
+ * With --both, the lanes of the device Rx follow the ones of the host Rx as
+ * extra receivers [lane + num_lanes, lane + 2 * num_lanes), so that every
+ * point configures, polls and records all of them at once. Results of both
+ * sides are kept in one grid, one report slot per side.
+ */
+static int eom_nr_sides(void)
+{
+	return both ? 2 : 1;
+}
+
+static int eom_nr_rx(void)
+{
+	return eom_data.num_lanes * eom_nr_sides();
+}
+
+static int eom_rx_lane(int rx)
+{
+	return lane + (rx - lane) % eom_data.num_lanes;
+}
+
+static int eom_rx_slot(int rx)
+{
+	return (rx - lane) / eom_data.num_lanes;
+}
+
+static int eom_slot_side(int slot)
+{
+	return both ? (slot ? PEER : LOCAL) : eom_data.local_peer;
+}
+
+static int eom_rx_peer(int peer, int rx)
+{
+	return both ? eom_slot_side(eom_rx_slot(rx)) : peer;
+}
+
+/*
+ * With -D, traffic threads keep the link busy with writes, which exercise
+ * the device Rx, and reads, which exercise the host Rx, while the scan thread
+ * polls the Eye Monitor at its own cadence. No I/O is in flight while a PMC is
+ * in progress: a burst returns once every I/O it issued has completed.
+ *
+ * Writes come from the buffers of io_pool, in turn with --pattern rotate,
+ * reads go to the buffers of tmp_buf. The sync engine writes a pattern buffer
+ * to each thread's own EOM_TEMP_DATA_SIZE region of the target and reads it
+ * back.
+ */
+static int eom_sync_burst(struct eom_io_worker *w)
+{
+	off_t off = (off_t)w->id * EOM_TEMP_DATA_SIZE;
+	ssize_t len;
+
+	len = pwrite(tmp_fd, eom_pattern_pool_buf(&io_pool, w->next++ % io_pool.nr), EOM_TEMP_DATA_SIZE, off);
+	if (len < 0)
+		return errno;
+	__atomic_fetch_add(&io_bytes, len, __ATOMIC_RELAXED);
+	w->ios++;
+
+	if (io_read) {
+		len = pread(tmp_fd, w->buf, EOM_TEMP_DATA_SIZE, off);
+		if (len < 0)
+			return errno;
+		__atomic_fetch_add(&io_bytes, len, __ATOMIC_RELAXED);
+		w->ios++;
 	}
 
-	/* EOM has stopped, good to log results */
-	if (eom_tested_count >= target_count || eom_error_count >= EOM_PHY_ERROR_COUNT_THRESHOLD) {
-		if (verbose)
-			printf("lane: %d timing: %d voltage: %d error count: %d [tested_count: %d]\n", lane, timing, volt,
-												       eom_error_count,
-												       eom_tested_count);
-
-		data->er[data->data_cnt].lane = lane;
-		data->er[data->data_cnt].timing = timing;
-		data->er[data->data_cnt].volt = volt;
-		data->er[data->data_cnt].error_cnt = eom_error_count;
-		data->data_cnt ++;
-		if (data->data_cnt > eom_result_count) {
-			pr_err("The count of data exceeds the maximum %d of the device\n", eom_result_count);
-			return ERROR;
+	return 0;
+}
+
+/*
+ * Next I/O of the trace for @w, NULL if it is not due yet, @wait_ns before it
+ * is. The trace plays from @base in time, in a loop. With --io-trace-afap,
+ * every I/O is due, only the queue depth holds them back.
+ */
+static struct eom_trace_io *eom_trace_next(struct eom_io_worker *w, __u64 base, __u64 *wait_ns)
+{
+	struct eom_trace_io *tio = &io_trace.ios[w->trace_pos];
+	__u64 due = base + w->trace_loop_ns + tio->time_ns, now;
+
+	if (!io_trace_afap) {
+		now = eom_now_ns();
+		if (due > now) {
+			*wait_ns = due - now;
+			return NULL;
 		}
+	}
 
-		return SUCCESS;
+	w->trace_ns = w->trace_loop_ns + tio->time_ns;
+	if (++w->trace_pos == io_trace.nr) {
+		w->trace_pos = 0;
+		w->trace_loop_ns = w->trace_ns;
 	}
 
-	/* EOM is running or has not yet started */
-	goto repeat_eom_scan;
+	return tio;
 }
 
-static int generate_eom_report(char *eom_file, struct EOMData *data)
+/*
+ * The uring engine keeps io_qd random reads and writes of io_bs bytes in
+ * flight until the traffic is paused or stopped. Then it waits for the I/Os
+ * in flight to complete. Reads go to the registered buffer of their slot,
+ * writes come from successive io_bs chunks of the registered pattern buffers.
+ *
+ * With --io-trace, it issues the I/Os of the trace instead, each when it is
+ * due. The trace clock stops while the traffic is paused, so that the idle
+ * gaps of the trace, which let the link enter Hibern8 or scale its gear,
+ * are kept whole around a Power Mode Change.
+ */
+static int eom_uring_burst(struct eom_io_worker *w)
 {
-	char mname[MANUFACTURER_NAME_STRING_DESC_SIZE];
-	char pname[PRODUCT_NAME_STRING_DESC_SIZE];
-	char pver[PRODUCT_REVISION_LEVEL_STRING_DESC_SIZE];
-	int i, ret;
-	FILE *file;
+	int free_slots[EOM_IO_QD_MAX], nr_free, inflight = 0, slot, err = 0, ret, p, i;
+	unsigned int chunks = EOM_TEMP_DATA_SIZE / io_bs;
+	__u64 span = io_blocks * io_bs, base = 0, wait_ns, off;
+	struct eom_trace_io *tio = NULL;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	__u32 len = io_bs;
+	bool write;
+
+	for (i = 0; i < io_qd; i++)
+		free_slots[i] = i;
+	nr_free = io_qd;
+
+	if (io_trace.nr)
+		base = eom_now_ns() - w->trace_ns;
+
+	while (true) {
+		wait_ns = 0;
+		while (nr_free && !err && !__atomic_load_n(&io_paused, __ATOMIC_RELAXED) &&
+		       !__atomic_load_n(&io_stop, __ATOMIC_RELAXED)) {
+			if (io_trace.nr) {
+				tio = eom_trace_next(w, base, &wait_ns);
+				if (!tio)
+					break;
+			}
 
-	ret = get_device_info(mname, pname, pver);
-	if (ret)
-		return ret;
+			sqe = eom_uring_get_sqe(&io_ring);
+			if (!sqe)
+				break;
+
+			if (tio) {
+				/* Offsets beyond the target wrap around, the I/O stays within it */
+				write = tio->write;
+				len = tio->len;
+				off = tio->off % span;
+				if (off + len > span)
+					off = span - len;
+			} else {
+				write = (int)(fast_rand64(&w->seed) % 100) < io_write_pct;
+				off = (fast_rand64(&w->seed) % io_blocks) * io_bs;
+			}
 
-	file = fopen(eom_file, "w");
-	if (!file) {
-		pr_err("Failed to create EOM result file %s\n", eom_file);
-		return ERROR;
-	}
+			slot = free_slots[--nr_free];
+			sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+			sqe->flags = IOSQE_FIXED_FILE;
+			sqe->fd = 0;
+			if (write) {
+				p = w->next % io_pool.nr;
+				sqe->addr = (unsigned long)(eom_pattern_pool_buf(&io_pool, p) +
+							    (size_t)(w->next / io_pool.nr % chunks) * io_bs);
+				sqe->buf_index = io_qd + p;
+				w->next++;
+			} else {
+				sqe->addr = (unsigned long)(w->buf + (size_t)slot * io_bs);
+				sqe->buf_index = slot;
+			}
+			sqe->len = len;
+			sqe->off = off;
+			sqe->user_data = slot;
+			inflight++;
+		}
 
-	fprintf(file, "UFS %s Side Eye Monitor Start\n", data->local_peer ? "Device" : "Host");
-	fprintf(file, "- - - - UFS INQUIRY ID: %s %s %s\n", mname, pname, pver);
-	fprintf(file, "- - - - UFS Gear Speed: HS-G%d Rate-%c\n", data->gear, data->rate == PA_HS_MODE_A ? 'A' : 'B');
-	fprintf(file, "EOM Capabilities:\n");
-	fprintf(file, "TimingMaxSteps %d TimingMaxOffset %d\n", data->timing_max_steps, data->timing_max_offset);
-	fprintf(file, "VoltageMaxSteps %d VoltageMaxOffset %d\n\n", data->voltage_max_steps, data->voltage_max_offset);
+		if (!inflight && !wait_ns)
+			break;
 
-	for (i = 0; i < data->data_cnt; i++)
-		fprintf(file, "lane: %d timing: %d voltage: %d error count: %d\n", data->er[i].lane, data->er[i].timing,
-										   data->er[i].volt, data->er[i].error_cnt);
+		if (wait_ns)
+			ret = eom_uring_submit_and_wait_timeout(&io_ring, 1, wait_ns < EOM_IO_TRACE_WAIT_MAX_NS ?
+										     wait_ns : EOM_IO_TRACE_WAIT_MAX_NS);
+		else
+			ret = eom_uring_submit_and_wait(&io_ring, 1);
+		if (ret < 0)
+			return -ret;
+
+		while ((cqe = eom_uring_peek_cqe(&io_ring))) {
+			free_slots[nr_free++] = cqe->user_data;
+			if (cqe->res < 0)
+				err = -cqe->res;
+			else
+				__atomic_fetch_add(&io_bytes, cqe->res, __ATOMIC_RELAXED);
+			eom_uring_cqe_seen(&io_ring);
+			inflight--;
+			w->ios++;
+		}
+	}
 
-	fclose(file);
-	printf("EOM results saved to %s\n", eom_file);
+	return err;
+}
 
-	return SUCCESS;
+static void *eom_io_worker_fn(void *arg)
+{
+	struct eom_io_worker *w = arg;
+	int err;
+
+	pthread_mutex_lock(&io_lock);
+	while (!io_stop) {
+		if (io_paused) {
+			pthread_cond_wait(&io_cond, &io_lock);
+			continue;
+		}
+		io_busy++;
+		pthread_mutex_unlock(&io_lock);
+
+		if (io_engine == EOM_IO_URING)
+			err = eom_uring_burst(w);
+		else
+			err = eom_sync_burst(w);
+
+		pthread_mutex_lock(&io_lock);
+		io_busy--;
+		if (io_paused && !io_busy)
+			pthread_cond_broadcast(&io_cond);
+		if (err) {
+			io_failed = err;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&io_lock);
+
+	return NULL;
 }
 
-static int check_output_path(const char *path)
+/* Wait for the I/O in flight to complete and hold back new I/O */
+static void eom_io_pause(void)
 {
-	int i = 0, length = strlen(path);
+	__u64 start = eom_now_ns();
 
-	for (; i < length; i++)
-		if (path[i] == ' ')
-			return ERROR;
+	pthread_mutex_lock(&io_lock);
+	io_paused = true;
+	while (io_busy)
+		pthread_cond_wait(&io_cond, &io_lock);
+	pthread_mutex_unlock(&io_lock);
 
-	if (path[length - 1] != '/')
-		return ERROR;
+	if (nr_io_workers)
+		eom_phase_add(EOM_PHASE_IO_DRAIN, start);
+}
 
-	return SUCCESS;
+static void eom_io_resume(void)
+{
+	pthread_mutex_lock(&io_lock);
+	io_paused = false;
+	pthread_cond_broadcast(&io_cond);
+	pthread_mutex_unlock(&io_lock);
 }
 
-static int init_lane(void)
+static void eom_io_stop(void)
 {
-	int l, ret;
+	unsigned long long ios = 0;
+	int i;
 
-	ret = get_value_from_cli(&l);
-	if (ret) {
-		pr_err("Invalid input for Lane number\n");
-		return ERROR;
-	}
+	if (!nr_io_workers)
+		return;
 
-	if (l < 0 || l > 1) {
-		pr_err("Invalid Lane number\n");
-		return ERROR;
+	pthread_mutex_lock(&io_lock);
+	io_stop = true;
+	pthread_cond_broadcast(&io_cond);
+	pthread_mutex_unlock(&io_lock);
+
+	for (i = 0; i < nr_io_workers; i++) {
+		pthread_join(io_workers[i].thread, NULL);
+		ios += io_workers[i].ios;
 	}
+	nr_io_workers = 0;
 
-	lane = l;
-	eom_data.num_lanes = 1;
+	if (io_engine == EOM_IO_URING)
+		eom_uring_exit(&io_ring);
 
-	return SUCCESS;
+	if (verbose)
+		printf("Stress I/O: %llu I/Os, %llu MB\n", ios, (unsigned long long)(io_bytes >> 20));
 }
 
-static int init_target_test_count(void)
+static void eom_io_target_path(char *path, size_t len)
 {
-	int t, ret;
+	if (io_target[0] != '\0')
+		snprintf(path, len, "%s", io_target);
+	else
+		snprintf(path, len, "%s%s", output_path, ufseom_tmp_file);
+}
 
-	ret = get_value_from_cli(&t);
-	if (ret) {
-		pr_err("Invalid input for target test count\n");
+/*
+ * LUN of the LU the -D target is on, from its SCSI address in sysfs, or
+ * ERROR if it is not on a UFS LU (e.g. on a device mapper target).
+ */
+static int eom_io_target_lun(void)
+{
+	char path[1040], sys[PATH_MAX], dev[PATH_MAX], *p;
+	struct stat st;
+	dev_t devt;
+	int lun;
+
+	eom_io_target_path(path, sizeof(path));
+	if (stat(path, &st) && stat(output_path, &st))
 		return ERROR;
-	}
 
-	if (t <= 0 || t > EOM_TARGET_TEST_COUNT_MAX) {
-		pr_err("Invalid target test count\n");
+	devt = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+	snprintf(sys, sizeof(sys), "/sys/dev/block/%u:%u/partition", major(devt), minor(devt));
+	snprintf(sys, sizeof(sys), access(sys, F_OK) ? "/sys/dev/block/%u:%u/device" : "/sys/dev/block/%u:%u/../device",
+		 major(devt), minor(devt));
+	if (!realpath(sys, dev))
 		return ERROR;
-	}
 
-	target_test_count = t;
+	p = strrchr(dev, '/');
+	if (sscanf(p + 1, "%*d:%*d:%*d:%d", &lun) != 1 || lun < 0 || lun > EOM_UFS_MAX_LUN)
+		return ERROR;
 
-	return SUCCESS;
+	return lun;
 }
 
-static int parse_args(int argc, char *argv[])
+/*
+ * Size the uring stress from what the device reports, for every I/O to keep
+ * the link busy without stalling on the device:
+ * - alignment: bMinAddrBlockSize, or the logical block size of the LU if larger
+ * - block size: the larger optimal read/write block size, raised to the smaller
+ *   of the device data buffers and to at least EOM_IO_BS_DEFAULT so that the
+ *   command overhead stays small, then rounded up to whole optimal blocks and
+ *   Data UPIUs of bMaxDataInSize/bMaxDataOutSize
+ * - queue depth: bQueueDepth, or bLUQueueDepth with per-LU queuing
+ * A queue depth the device does not report falls back to the default, --io-qd
+ * and --io-bs override.
+ */
+static int eom_io_geometry(void)
 {
-	int i, c = 0, ret = ERROR;
+	__u8 desc_buf[DESCRIPTOR_BUFFER_SIZE] = {0};
+	int min_addr, opt_rd, opt_wr, opt, buf_in, buf_out, buf, upiu, qd, lun, lbs, bs;
+	__u64 in = 0, out = 0;
 
-	if (argc < 2) {
-		pr_err("Too less args, try 'ufseom -h'\n");
+	if (io_engine != EOM_IO_URING)
+		return SUCCESS;
+
+	if (query_read_descriptor(bsg_fd, GEOMETRY_DESCRIPTOR_IDN, 0, 0, desc_buf, DESCRIPTOR_BUFFER_SIZE)) {
+		pr_err("Failed to read Geometry Descriptor\n");
+		return ERROR;
+	}
+	min_addr = desc_buf[GEOMETRY_MIN_ADDR_BLOCK_SIZE_OFFSET] * EOM_UFS_UNIT_SIZE;
+	opt_rd = desc_buf[GEOMETRY_OPTIMAL_READ_BLOCK_SIZE_OFFSET] * EOM_UFS_UNIT_SIZE;
+	opt_wr = desc_buf[GEOMETRY_OPTIMAL_WRITE_BLOCK_SIZE_OFFSET] * EOM_UFS_UNIT_SIZE;
+	buf_in = desc_buf[GEOMETRY_MAX_IN_BUFFER_SIZE_OFFSET] * EOM_UFS_UNIT_SIZE;
+	buf_out = desc_buf[GEOMETRY_MAX_OUT_BUFFER_SIZE_OFFSET] * EOM_UFS_UNIT_SIZE;
+	if (buf_in && buf_out)
+		buf = buf_in < buf_out ? buf_in : buf_out;
+	else
+		buf = buf_in ? buf_in : buf_out;
+
+	if (query_read_attribute(bsg_fd, MAX_DATA_IN_SIZE_IDN, 0, 0, &in) ||
+	    query_read_attribute(bsg_fd, MAX_DATA_OUT_SIZE_IDN, 0, 0, &out))
+		in = out = 0;
+	upiu = (in > out ? in : out) * EOM_UFS_UNIT_SIZE;
+
+	if (query_read_descriptor(bsg_fd, DEVICE_DESCRIPTOR_IDN, 0, 0, desc_buf, DESCRIPTOR_BUFFER_SIZE)) {
+		pr_err("Failed to read Device Descriptor\n");
+		return ERROR;
+	}
+	qd = desc_buf[DEVICE_QUEUE_DEPTH_OFFSET];
+
+	lun = eom_io_target_lun();
+	if (lun >= 0 && !query_read_descriptor(bsg_fd, UNIT_DESCRIPTOR_IDN, lun, 0, desc_buf, DESCRIPTOR_BUFFER_SIZE)) {
+		if (!qd)
+			qd = desc_buf[UNIT_LU_QUEUE_DEPTH_OFFSET];
+		lbs = desc_buf[UNIT_LOGICAL_BLOCK_SIZE_OFFSET] < 31 ? 1 << desc_buf[UNIT_LOGICAL_BLOCK_SIZE_OFFSET] : 0;
+		if (lbs > min_addr)
+			min_addr = lbs;
+	}
+
+	/* Whole pages at least, for O_DIRECT */
+	io_align = min_addr > EOM_TEMP_DATA_MEM_ALIGN_SIZE ? min_addr : EOM_TEMP_DATA_MEM_ALIGN_SIZE;
+	if (io_align > EOM_TEMP_DATA_SIZE || EOM_TEMP_DATA_SIZE % io_align) {
+		pr_err("Unsupported minimum addressable block size %d\n", io_align);
+		return ERROR;
+	}
+
+	opt = opt_rd > opt_wr ? opt_rd : opt_wr;
+	bs = opt > buf ? opt : buf;
+	if (bs < EOM_IO_BS_DEFAULT)
+		bs = EOM_IO_BS_DEFAULT;
+	if (opt)
+		bs = (bs + opt - 1) / opt * opt;
+	if (upiu)
+		bs = (bs + upiu - 1) / upiu * upiu;
+	bs = (bs + io_align - 1) / io_align * io_align;
+
+	if (io_bs == INIT) {
+		io_bs = bs < EOM_TEMP_DATA_SIZE ? bs : EOM_TEMP_DATA_SIZE;
+	} else if (io_bs % io_align) {
+		pr_err("I/O block size must be a multiple of %d on this device\n", io_align);
+		return ERROR;
+	}
+	if (io_qd == INIT)
+		io_qd = !qd ? EOM_IO_QD_DEFAULT : qd < EOM_IO_QD_MAX ? qd : EOM_IO_QD_MAX;
+
+	printf("Stress I/O: QD %d, %d bytes per I/O, %d byte alignment\n", io_qd, io_bs, io_align);
+	if (verbose)
+		printf("Stress I/O: LU %d, Data UPIU %d bytes, optimal blocks %d/%d bytes, buffers %d/%d bytes\n", lun,
+		       upiu, opt_rd, opt_wr, buf_in, buf_out);
+
+	return SUCCESS;
+}
+
+/* With --io-trace, the slot buffers fit the largest I/O of the trace */
+static int eom_io_load_trace(void)
+{
+	if (io_trace_path[0] == '\0')
+		return SUCCESS;
+
+	if (eom_trace_load(&io_trace, io_trace_path, io_align, EOM_TEMP_DATA_SIZE))
+		return ERROR;
+
+	io_bs = io_trace.max_len;
+	io_write_pct = io_trace.write_pct;
+
+	if (verbose)
+		printf("Stress I/O: %d I/Os of up to %d bytes, %d%% writes, over %.3fs in %s\n", io_trace.nr, io_bs,
+		       io_write_pct, io_trace.ios[io_trace.nr - 1].time_ns / 1e9, io_trace_path);
+
+	return SUCCESS;
+}
+
+static size_t eom_io_buf_size(void)
+{
+	if (io_engine == EOM_IO_URING)
+		return (size_t)io_qd * io_bs;
+
+	return (size_t)EOM_TEMP_DATA_SIZE * io_threads;
+}
+
+/*
+ * Open the -D target, the temporary file in the output folder by default,
+ * and size the area the stress I/O goes to.
+ */
+static int eom_io_open_target(void)
+{
+	__u64 size = eom_io_buf_size();
+	char path[1040];
+	struct stat st;
+	bool exists, blk;
+
+	eom_io_target_path(path, sizeof(path));
+
+	exists = !stat(path, &st);
+	blk = exists && S_ISBLK(st.st_mode);
+	if (blk && (io_engine == EOM_IO_SYNC || io_write_pct) && !io_force) {
+		pr_err("Refusing to write to block device %s without --io-force\n", path);
+		return ERROR;
+	}
+
+	tmp_fd = open(path, O_RDWR | O_DIRECT | O_CREAT, S_IWUSR | S_IRUSR);
+	if (tmp_fd < 0) {
+		pr_err("Failed to open file %s (%d)\n", path, tmp_fd);
+		return ERROR;
+	}
+
+	if (blk) {
+		if (ioctl(tmp_fd, BLKGETSIZE64, &size)) {
+			pr_err("Failed to get size of %s\n", path);
+			return ERROR;
+		}
+	} else if (io_engine == EOM_IO_URING) {
+		/* A given file is stressed as a whole if it is larger */
+		size = EOM_IO_FILE_SIZE;
+		if (exists && io_target[0] != '\0' && (__u64)st.st_size > size)
+			size = st.st_size;
+	}
+
+	if (size < eom_io_buf_size()) {
+		pr_err("Target %s is smaller than the %zu bytes stressed at once\n", path, eom_io_buf_size());
+		return ERROR;
+	}
+	io_blocks = size / (io_engine == EOM_IO_URING ? io_bs : EOM_TEMP_DATA_SIZE);
+
+	if (verbose)
+		printf("Stress I/O: %s engine on %s (%llu MB)\n", io_engine == EOM_IO_URING ? "uring" : "sync", path,
+		       (unsigned long long)(size >> 20));
+
+	return SUCCESS;
+}
+
+/*
+ * Reads of a file only go over the link where it has data, write the whole
+ * uring area of a file once. The sync engine writes before it reads.
+ */
+static int eom_io_fill_target(void)
+{
+	struct stat st;
+	__u64 b;
+
+	if (io_engine == EOM_IO_SYNC)
+		return SUCCESS;
+
+	if (fstat(tmp_fd, &st) || S_ISBLK(st.st_mode) || (__u64)st.st_size >= io_blocks * io_bs)
+		return SUCCESS;
+
+	for (b = 0; b < io_blocks; b++) {
+		if (pwrite(tmp_fd, eom_pattern_pool_buf(&io_pool, b % io_pool.nr), io_bs, b * io_bs) != io_bs) {
+			pr_err("Failed to fill the stress target (%d)\n", errno);
+			return ERROR;
+		}
+	}
+	fsync(tmp_fd);
+
+	return SUCCESS;
+}
+
+static int eom_io_start(void)
+{
+	struct eom_io_worker *w;
+	int i, ret;
+
+	if (!do_io)
+		return SUCCESS;
+
+	io_stop = false;
+	io_paused = false;
+	io_failed = 0;
+	/* Writes and reads exercise both sides with --both */
+	io_read = both || eom_data.local_peer == LOCAL;
+
+	if (io_engine == EOM_IO_URING) {
+		struct iovec iovs[EOM_IO_QD_MAX + EOM_PATTERN_MAX];
+
+		for (i = 0; i < io_qd; i++) {
+			iovs[i].iov_base = tmp_buf + (size_t)i * io_bs;
+			iovs[i].iov_len = io_bs;
+		}
+		for (i = 0; i < io_pool.nr; i++) {
+			iovs[io_qd + i].iov_base = eom_pattern_pool_buf(&io_pool, i);
+			iovs[io_qd + i].iov_len = io_pool.size;
+		}
+
+		if (eom_uring_init(&io_ring, io_qd))
+			return ERROR;
+		if (eom_uring_register_buffers(&io_ring, iovs, io_qd + io_pool.nr) || eom_uring_register_file(&io_ring, tmp_fd)) {
+			eom_uring_exit(&io_ring);
+			return ERROR;
+		}
+	}
+
+	/* One thread drives the whole ring */
+	for (i = 0; i < (io_engine == EOM_IO_URING ? 1 : io_threads); i++) {
+		w = &io_workers[i];
+		w->id = i;
+		w->ios = 0;
+		w->trace_pos = 0;
+		w->trace_ns = 0;
+		w->trace_loop_ns = 0;
+		/* Threads start at different patterns with --pattern rotate */
+		w->next = i;
+		if (io_engine == EOM_IO_URING) {
+			w->buf = tmp_buf;
+			w->seed = EOM_IO_SEED;
+		} else {
+			w->buf = tmp_buf + (size_t)i * EOM_TEMP_DATA_SIZE;
+		}
+
+		ret = pthread_create(&w->thread, NULL, eom_io_worker_fn, w);
+		if (ret) {
+			pr_err("Failed to create I/O thread (%d)\n", ret);
+			if (nr_io_workers)
+				eom_io_stop();
+			else if (io_engine == EOM_IO_URING)
+				eom_uring_exit(&io_ring);
+			return ERROR;
+		}
+		nr_io_workers++;
+	}
+
+	return SUCCESS;
+}
+
+static int eom_wait_pmc(void)
+{
+	struct eom_wait_model *wm = eom_wait_model();
+	__u64 start = eom_now_ns(), backoff_us = 0, before_ns = 0, seen_ns;
+	int ret;
+
+	/* Poll UniPro State to confirm PMC is done, from shortly before the link usually comes up */
+	while (1) {
+		eom_wait_next(start, &wm->link_up_ns, wm->link_up_ns ? 1 : 0, &backoff_us);
+		seen_ns = eom_now_ns() - start;
+		ret = uic_get(bsg_fd, UIC_ARG_MIB_SEL(QCOM_DME_VS_UNIPRO_STATE, SELECT_TX(0)), 0);
+		if (ret < 0) {
+			/* Failed to get QCOM_DME_VS_UNIPRO_STATE, maybe not supported? */
+			break;
+		} else if ((ret & QCOM_DME_VS_UNIPRO_STATE_MASK) == QCOM_DME_VS_UNIPRO_STATE_LINK_UP) {
+			eom_wait_learn(&wm->link_up_ns, before_ns, seen_ns);
+			break;
+		}
+		before_ns = seen_ns;
+	}
+
+	/* QCOM_DME_VS_UNIPRO_STATE not supported? Delay a bit to make sure PMC is completed */
+	if (ret < 0)
+		usleep(200000);
+
+	eom_phase_add(EOM_PHASE_LINK_UP, start);
+
+	return SUCCESS;
+}
+
+static int power_mode_change(void)
+{
+	__u64 start = eom_now_ns(), no_adapt_ns;
+	int ret;
+
+	/* Select NO_ADAPT */
+	ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(PA_TXHSADAPTTYPE, SELECT_TX(0)), ATTR_SET_NOR, PA_NO_ADAPT, 0);
+	if (ret) {
+		pr_err("Failed to set NO_ADAPT\n");
+		return ret;
+	}
+	no_adapt_ns = eom_now_ns() - start;
+
+	/* Do a Power Mode Change to Fast Mode to apply NO_ADAPT and also trigger a RCT to kick start EOM */
+	eom_io_pause();
+	/* The I/O drain is a phase of its own, the PMC phase is both writes */
+	start = eom_now_ns() - no_adapt_ns;
+	ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(PA_PWRMODE, SELECT_TX(0)), ATTR_SET_NOR, 0x11, 0);
+	eom_phase_add(EOM_PHASE_PMC, start);
+	if (!ret) {
+		eom_data.pmc_cnt++;
+		ret = eom_wait_pmc();
+	}
+	eom_io_resume();
+	if (ret)
+		pr_err("Failed to trigger RCT\n");
+
+	return ret;
+}
+
+/*
+ * Move the link to the given gears and rate series with a Power Mode Change,
+ * applying @adapt as the adapt type of the new mode. Eye Monitor has to be
+ * configured again afterwards.
+ */
+static int eom_set_power_mode(int tx_gear, int rx_gear, int rate, int adapt, int pwr_mode)
+{
+	__u64 start;
+	int ret;
+
+	ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(PA_TXGEAR, SELECT_TX(0)), ATTR_SET_NOR, tx_gear, 0);
+	if (!ret)
+		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(PA_RXGEAR, SELECT_TX(0)), ATTR_SET_NOR, rx_gear, 0);
+	if (!ret)
+		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(PA_HSSERIES, SELECT_TX(0)), ATTR_SET_NOR, rate, 0);
+	if (!ret)
+		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(PA_TXHSADAPTTYPE, SELECT_TX(0)), ATTR_SET_NOR, adapt, 0);
+	if (ret) {
+		pr_err("Failed to set power mode parameters for HS-G%d Rate-%c\n", rx_gear,
+		       rate == PA_HS_MODE_A ? 'A' : 'B');
+		return ret;
+	}
+
+	eom_io_pause();
+	start = eom_now_ns();
+	ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(PA_PWRMODE, SELECT_TX(0)), ATTR_SET_NOR, pwr_mode, 0);
+	eom_phase_add(EOM_PHASE_PMC, start);
+	if (!ret) {
+		eom_data.pmc_cnt++;
+		eom_data.eom_armed = false;
+		ret = eom_wait_pmc();
+	}
+	eom_io_resume();
+	if (ret)
+		pr_err("Failed to change power mode to HS-G%d Rate-%c\n", rx_gear, rate == PA_HS_MODE_A ? 'A' : 'B');
+
+	return ret;
+}
+
+static int config_eom(int peer, int timing, int volt, int target_count)
+{
+	__u64 start = eom_now_ns();
+	int l, ret;
+
+	/* All lanes, of both sides with --both, are configured for the same point and share one PMC */
+	for (l = lane; l < lane + eom_nr_rx(); l++) {
+		/* Enable Eye Monitor */
+		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_ENABLE, SELECT_RX(eom_rx_lane(l))), ATTR_SET_NOR, 1, eom_rx_peer(peer, l));
+		if (ret) {
+			pr_err("Failed to set RX_EYEMON_Enable\n");
+			return ret;
+		}
+
+		/* Config Eye Monitor timing steps */
+		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_TIMING_STEPS, SELECT_RX(eom_rx_lane(l))), ATTR_SET_NOR, timing,
+			      eom_rx_peer(peer, l));
+		if (ret) {
+			pr_err("Failed to set RX_EYEMON_Timing_Steps\n");
+			return ret;
+		}
+
+		/* Config Eye Monitor voltage steps */
+		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_VOLTAGE_STEPS, SELECT_RX(eom_rx_lane(l))), ATTR_SET_NOR, volt,
+			      eom_rx_peer(peer, l));
+		if (ret) {
+			pr_err("Failed to set RX_EYEMON_Voltage_Steps\n");
+			return ret;
+		}
+
+		/* Config Eye Monitor target test count */
+		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_TARGET_TEST_COUNT, SELECT_RX(eom_rx_lane(l))),
+					ATTR_SET_NOR, target_count, eom_rx_peer(peer, l));
+		if (ret) {
+			pr_err("Failed to set RX_EYEMON_Target_Test_Count\n");
+			return ret;
+		}
+	}
+
+	eom_data.armed_target_cnt = target_count;
+	eom_phase_add(EOM_PHASE_CONFIG, start);
+
+	return power_mode_change();
+}
+
+static int eom_get_counters(int peer, int l, int *tested_cnt, int *error_cnt)
+{
+	/* Get RX_EYEMON_Tested_Count */
+	*tested_cnt = uic_get(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_TESTED_COUNT, SELECT_RX(eom_rx_lane(l))),
+			      eom_rx_peer(peer, l));
+	if (*tested_cnt < 0) {
+		pr_err("Failed to get RX_EYEMON_Tested_Count\n");
+		return ERROR;
+	}
+
+	/* Get RX_EYEMON_Error_Count */
+	*error_cnt = uic_get(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_ERROR_COUNT, SELECT_RX(eom_rx_lane(l))),
+			     eom_rx_peer(peer, l));
+	if (*error_cnt < 0) {
+		pr_err("Failed to get RX_EYEMON_Error_Count\n");
+		return ERROR;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ * Incremental mode: once the Eye Monitor is enabled and NO_ADAPT is applied
+ * by the PMC of the first point, following points only update the
+ * timing/voltage steps and restart the measurement through RX_EYEMON_Start.
+ *
+ * A measurement is much shorter than a UIC command, it often completes before
+ * the first poll, and neighbouring points give the same counters. So before
+ * the restart the Eye Monitor is disabled and enabled again, which clears the
+ * counters to 0: a completed measurement leaves them changed, unless it ran to
+ * target test count 0.
+ */
+static int start_eom(int peer, int timing, int volt, int target_count)
+{
+	struct EOMData *data = &eom_data;
+	__u64 start = eom_now_ns();
+	int l, ret;
+
+	for (l = lane; l < lane + eom_nr_rx(); l++) {
+		if (target_count != eom_data.armed_target_cnt) {
+			ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_TARGET_TEST_COUNT, SELECT_RX(eom_rx_lane(l))),
+				      ATTR_SET_NOR, target_count, eom_rx_peer(peer, l));
+			if (ret) {
+				pr_err("Failed to set RX_EYEMON_Target_Test_Count\n");
+				return ret;
+			}
+		}
+
+		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_TIMING_STEPS, SELECT_RX(eom_rx_lane(l))), ATTR_SET_NOR, timing,
+			      eom_rx_peer(peer, l));
+		if (ret) {
+			pr_err("Failed to set RX_EYEMON_Timing_Steps\n");
+			return ret;
+		}
+
+		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_VOLTAGE_STEPS, SELECT_RX(eom_rx_lane(l))), ATTR_SET_NOR, volt,
+			      eom_rx_peer(peer, l));
+		if (ret) {
+			pr_err("Failed to set RX_EYEMON_Voltage_Steps\n");
+			return ret;
+		}
+
+		if (!data->counters_kept) {
+			ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_ENABLE, SELECT_RX(eom_rx_lane(l))), ATTR_SET_NOR, 0,
+				      eom_rx_peer(peer, l));
+			if (!ret)
+				ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_ENABLE, SELECT_RX(eom_rx_lane(l))),
+					      ATTR_SET_NOR, 1, eom_rx_peer(peer, l));
+			if (ret) {
+				pr_err("Failed to re-enable Eye Monitor\n");
+				return ret;
+			}
+		}
+
+		ret = eom_get_counters(peer, l, &data->start_tested_cnt[l], &data->start_error_cnt[l]);
+		if (ret)
+			return ret;
+
+		/*
+		 * Without the clear, a restart can only be confirmed by seeing it run
+		 * or its counters change, there is no point re-enabling it again.
+		 */
+		if (!data->counters_kept && (data->start_tested_cnt[l] || data->start_error_cnt[l])) {
+			data->counters_kept = true;
+			if (verbose)
+				printf("Re-enabling the Eye Monitor does not clear its counters\n");
+		}
+	}
+
+	for (l = lane; l < lane + eom_nr_rx(); l++) {
+		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_START, SELECT_RX(eom_rx_lane(l))), ATTR_SET_NOR, 1, eom_rx_peer(peer, l));
+		if (ret) {
+			pr_err("Failed to set RX_EYEMON_Start\n");
+			return ret;
+		}
+	}
+
+	data->armed_target_cnt = target_count;
+	eom_phase_add(EOM_PHASE_CONFIG, start);
+
+	return SUCCESS;
+}
+
+/**
+ * eom_poll - Wait for the running EOM measurements of all lanes to complete
+ * @peer: LOCAL or PEER
+ * @target_count: Target test count
+ * @max_polls: Give up after this many polls without seeing the measurement
+ *	       of every lane run, 0 to wait forever
+ * @error_cnt: Output error count, indexed by lane
+ * @tested_cnt: Output tested count, indexed by lane
+ *
+ * Returns SUCCESS, ERROR, or INIT if @max_polls is reached.
+ */
+static int eom_poll(int peer, int target_count, int max_polls, int *error_cnt, int *tested_cnt)
+{
+	struct EOMData *data = &eom_data;
+	int eom_start, eom_tested_count, eom_error_count;
+	bool started[EOM_MAX_RX] = {false};
+	bool done[EOM_MAX_RX] = {false};
+	int l, pending = eom_nr_rx(), polls = 0;
+	__u64 start_ns = eom_now_ns(), start_bytes = __atomic_load_n(&io_bytes, __ATOMIC_RELAXED), elapsed;
+	__u64 poll_ns, counters, backoff_us = 0, before_ns[EOM_MAX_RX] = {0};
+	struct eom_wait_model *wm = eom_wait_model();
+	double expect_ns[2];
+	/* A restart is only confirmed by seeing it run, which waiting for the completion would miss */
+	bool waiting = max_polls;
+
+	/* Lanes stop early at the error threshold outside the eye, or run to the target test count */
+	expect_ns[1] = eom_wait_full_ns(wm, target_count);
+	expect_ns[0] = wm->short_ns && wm->short_ns < expect_ns[1] ? wm->short_ns : expect_ns[1];
+
+	while (pending) {
+		if (__atomic_load_n(&io_failed, __ATOMIC_RELAXED)) {
+			pr_err("Failed to stress the link with I/O: %s\n", strerror(io_failed));
+			return ERROR;
+		}
+
+		eom_wait_next(start_ns, expect_ns, waiting ? 0 : 2, &backoff_us);
+
+		waiting = false;
+		/* The poll phase leaves the counter reads out */
+		poll_ns = eom_now_ns();
+		for (l = lane; l < lane + eom_nr_rx(); l++) {
+			if (done[l])
+				continue;
+
+			/* Get RX_EYEMON_Start */
+			eom_start = uic_get(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_START, SELECT_RX(eom_rx_lane(l))), eom_rx_peer(peer, l));
+			if (eom_start < 0) {
+				pr_err("Failed to get RX_EYEMON_Start, eom_start = %d\n", eom_start);
+				return ERROR;
+			}
+
+			/* EOM has not yet stopped */
+			if (eom_start & RX_EYEMON_START_MASK) {
+				started[l] = true;
+				before_ns[l] = eom_now_ns() - start_ns;
+				continue;
+			}
+
+			counters = eom_now_ns();
+			if (eom_get_counters(peer, l, &eom_tested_count, &eom_error_count))
+				return ERROR;
+			poll_ns += eom_phase_add(EOM_PHASE_COUNTERS, counters);
+
+			/*
+			 * When restarted through RX_EYEMON_Start, the counters hold what
+			 * they had before the restart until the new measurement runs. Only
+			 * trust them once the measurement was seen running or they changed.
+			 */
+			if (max_polls && !started[l] && eom_tested_count == data->start_tested_cnt[l] &&
+			    eom_error_count == data->start_error_cnt[l]) {
+				waiting = true;
+				continue;
+			}
+
+			/* EOM has stopped, good to log results */
+			if (eom_tested_count >= target_count || eom_error_count >= EOM_PHY_ERROR_COUNT_THRESHOLD) {
+				if (eom_error_count >= EOM_PHY_ERROR_COUNT_THRESHOLD)
+					eom_wait_learn(&wm->short_ns, before_ns[l], counters - start_ns);
+				else
+					eom_wait_learn(&wm->full_ns[target_count], before_ns[l], counters - start_ns);
+				error_cnt[l] = eom_error_count;
+				tested_cnt[l] = eom_tested_count;
+				done[l] = true;
+				pending--;
+				continue;
+			}
+
+			/* EOM is running or has not yet started */
+			if (!started[l])
+				waiting = true;
+		}
+		eom_phase_add(EOM_PHASE_POLL, poll_ns);
+
+		if (max_polls && waiting && ++polls >= max_polls)
+			return INIT;
+	}
+
+	/* Bytes per ns to MB/s */
+	elapsed = eom_now_ns() - start_ns;
+	if (elapsed)
+		data->io_mbps = (__atomic_load_n(&io_bytes, __ATOMIC_RELAXED) - start_bytes) * 1000 / elapsed;
+
+	return SUCCESS;
+}
+
+static int eom_measure_point(int peer, int timing, int volt, int target_count, bool full,
+			     int *error_cnt, int *tested_cnt)
+{
+	struct EOMData *data = &eom_data;
+	int timing_steps = eom_steps(timing);
+	int voltage_steps = eom_steps(volt);
+	int ret;
+
+	if (incremental && !full && data->eom_armed) {
+		ret = start_eom(peer, timing_steps, voltage_steps, target_count);
+		if (ret) {
+			pr_err("EOM cannot be restarted without PMC, fall back to full PMC mode\n");
+			incremental = false;
+		} else {
+			ret = eom_poll(peer, target_count, EOM_INCREMENTAL_START_POLLS, error_cnt, tested_cnt);
+			if (ret != INIT)
+				return ret;
+
+			/* The hardware did not pick the new point up, it needs a PMC */
+			data->pmc_fallback_cnt++;
+			if (verbose)
+				printf("timing: %d voltage: %d did not restart without PMC\n", timing, volt);
+		}
+	}
+
+	ret = config_eom(peer, timing_steps, voltage_steps, target_count);
+	if (ret) {
+		pr_err("Failed to configure EOM.\n");
+		return ret;
+	}
+
+	ret = eom_poll(peer, target_count, 0, error_cnt, tested_cnt);
+	if (ret)
+		return ret;
+
+	data->eom_armed = true;
+
+	return SUCCESS;
+}
+
+/*
+ * Account a measurement to the point phase, and flag it with -V when it took
+ * much longer than the median so far, which hints at a device hiccup.
+ */
+static void eom_point_time(int timing, int volt, __u64 start)
+{
+	struct EOMData *data = &eom_data;
+	__u64 median = eom_phase_percentile(EOM_PHASE_POINT, 50);
+	bool enough = eom_phases[EOM_PHASE_POINT].count >= EOM_SLOW_POINT_MIN_SAMPLES;
+	__u64 us = eom_phase_add(EOM_PHASE_POINT, start) / 1000;
+
+	data->point_us = us;
+	if (!enough || us <= median * EOM_SLOW_POINT_FACTOR)
+		return;
+
+	data->slow_cnt++;
+	if (verbose)
+		printf("timing: %d voltage: %d took %llu us, more than %d times the median\n", timing, volt,
+		       (unsigned long long)us, EOM_SLOW_POINT_FACTOR);
+}
+
+/**
+ * eom_measure - Measure one (timing, voltage) point on all lanes at once
+ * @peer: LOCAL or PEER
+ * @timing: Timing offset in steps
+ * @volt: Voltage offset in steps
+ * @target_count: Target test count
+ * @full: Force the Eye Monitor configuration with a PMC, even in incremental mode
+ * @error_cnt: Output error count, indexed by lane
+ * @tested_cnt: Output tested count, indexed by lane
+ */
+static int eom_measure(int peer, int timing, int volt, int target_count, bool full,
+		       int *error_cnt, int *tested_cnt)
+{
+	__u64 start = eom_now_ns();
+	int ret;
+
+	ret = eom_measure_point(peer, timing, volt, target_count, full, error_cnt, tested_cnt);
+	if (!ret)
+		eom_point_time(timing, volt, start);
+
+	return ret;
+}
+
+static int eom_result_index(int l, int timing, int volt)
+{
+	int nt = timing_right - timing_left + 1;
+	int nv = voltage_high - voltage_low + 1;
+
+	return ((l - lane) * nt + (timing - timing_left)) * nv + (volt - voltage_low);
+}
+
+static struct eom_result *eom_result_at(struct EOMData *data, int l, int timing, int volt)
+{
+	return &data->er[eom_result_index(l, timing, volt)];
+}
+
+/*
+ * Points are recorded one lane at a time, an interrupted scan may have left a
+ * point with only its first lanes. It counts as measured when all lanes are.
+ */
+static bool eom_point_measured(struct EOMData *data, int timing, int volt)
+{
+	int l;
+
+	for (l = lane; l < lane + eom_nr_rx(); l++)
+		if (!(eom_result_at(data, l, timing, volt)->flags & EOM_RESULT_MEASURED))
+			return false;
+
+	return true;
+}
+
+static const char *eom_result_tag(int flags)
+{
+	if (flags & EOM_RESULT_INFERRED)
+		return " inferred";
+	if (flags & EOM_RESULT_CARRIED)
+		return " carried";
+
+	return "";
+}
+
+static int eom_timing_max_offset(struct EOMData *data, int side)
+{
+	return both && side == PEER ? data->peer_timing_max_offset : data->timing_max_offset;
+}
+
+static int eom_voltage_max_offset(struct EOMData *data, int side)
+{
+	return both && side == PEER ? data->peer_voltage_max_offset : data->voltage_max_offset;
+}
+
+static void eom_report_header(FILE *file, struct EOMData *data, int side)
+{
+	fprintf(file, "UFS %s Side Eye Monitor Start\n", side ? "Device" : "Host");
+	fprintf(file, "- - - - UFS INQUIRY ID: %s %s %s\n", dev_mname, dev_pname, dev_pver);
+	fprintf(file, "- - - - UFS Gear Speed: HS-G%d Rate-%c\n", data->gear, data->rate == PA_HS_MODE_A ? 'A' : 'B');
+	fprintf(file, "EOM Capabilities:\n");
+	fprintf(file, "TimingMaxSteps %d TimingMaxOffset %d\n", data->timing_max_steps,
+		eom_timing_max_offset(data, side));
+	fprintf(file, "VoltageMaxSteps %d VoltageMaxOffset %d\n", data->voltage_max_steps,
+		eom_voltage_max_offset(data, side));
+	/* Stress level with -D, the sync engine writes and reads back 4MB per thread at a time */
+	if (do_io && io_engine == EOM_IO_URING) {
+		fprintf(file, "StressEngine uring StressQD %d\n", io_qd);
+		fprintf(file, "StressBS %d StressWrite %d\n", io_bs, io_write_pct);
+	} else if (do_io) {
+		fprintf(file, "StressEngine sync StressQD %d\n", io_threads);
+		fprintf(file, "StressBS %d StressWrite %d\n", EOM_TEMP_DATA_SIZE, io_read ? 50 : 100);
+	}
+	if (do_io)
+		fprintf(file, "StressPattern %s\n", eom_pattern_name(io_pattern));
+	if (io_trace.nr)
+		fprintf(file, "StressTrace %s StressIOs %d\n", io_trace_afap ? "afap" : "timed", io_trace.nr);
+	fprintf(file, "\n");
+}
+
+static void eom_report_point(FILE *file, struct eom_result *er)
+{
+	fprintf(file, "lane: %d timing: %d voltage: %d error count: %d", eom_rx_lane(er->lane), er->timing, er->volt,
+		er->error_cnt);
+	/* Target test count varies per point with --quick-target */
+	if (quick_target && er->target_cnt)
+		fprintf(file, " target: %d", er->target_cnt);
+	/* Stress I/O throughput while the point was measured with -D */
+	if (er->io_mbps)
+		fprintf(file, " io: %d", er->io_mbps);
+	/* Time to measure the point with --point-time */
+	if (point_time)
+		fprintf(file, " time: %d", er->point_us);
+	fprintf(file, "%s\n", eom_result_tag(er->flags));
+}
+
+/*
+ * Append a measured point to the report being streamed and rewrite the
+ * progress index in place. The stdio buffer is flushed for every point, so
+ * only a power loss can lose points, the report is synced every fsync_points
+ * points against that.
+ */
+static int eom_stream_point(struct eom_result *er)
+{
+	int slot = eom_rx_slot(er->lane);
+	char progress[64];
+	int len;
+
+	if (!stream_file[slot])
+		return SUCCESS;
+
+	eom_report_point(stream_file[slot], er);
+	if (fflush(stream_file[slot])) {
+		pr_err("Failed to write EOM report: %s\n", strerror(errno));
+		return ERROR;
+	}
+
+	/* Both sides are measured at the same points, so they progress together */
+	len = snprintf(progress, sizeof(progress), "%10d of %10d points %8llu s\n",
+		       eom_data.data_cnt / eom_nr_sides(), progress_total / eom_nr_sides(),
+		       (unsigned long long)((eom_now_ns() - stream_start_ns) / 1000000000));
+	if (pwrite(progress_fd[slot], progress, len, 0) != len) {
+		pr_err("Failed to write EOM progress index %s\n", progress_file[slot]);
+		return ERROR;
+	}
+
+	if (fsync_points && !(++stream_cnt[slot] % fsync_points)) {
+		fsync(fileno(stream_file[slot]));
+		fsync(progress_fd[slot]);
+	}
+
+	return SUCCESS;
+}
+
+/* Record the results of all lanes, of both sides with --both, at one point */
+static int eom_record(int timing, int volt, int count, int *eom_error_count, int *eom_tested_count)
+{
+	struct EOMData *data = &eom_data;
+	struct eom_result *er;
+	int l, ret;
+
+	for (l = lane; l < lane + eom_nr_rx(); l++) {
+		if (verbose)
+			printf("%slane: %d timing: %d voltage: %d error count: %d [tested_count: %d]\n",
+			       both ? (eom_rx_slot(l) ? "device " : "host ") : "", eom_rx_lane(l), timing, volt,
+												       eom_error_count[l],
+												       eom_tested_count[l]);
+
+		er = eom_result_at(data, l, timing, volt);
+		er->lane = l;
+		er->timing = timing;
+		er->volt = volt;
+		er->error_cnt = eom_error_count[l];
+		er->tested_cnt = eom_tested_count[l];
+		er->target_cnt = count;
+		er->io_mbps = data->io_mbps;
+		er->point_us = data->point_us;
+		/* A point re-measured at a higher target test count is appended again */
+		if (!(er->flags & EOM_RESULT_MEASURED)) {
+			/* Measuring another lane may replace a point inferred earlier */
+			if (er->flags & EOM_RESULT_INFERRED)
+				data->inferred_cnt--;
+			er->flags = EOM_RESULT_MEASURED;
+			data->data_cnt ++;
+			if (data->data_cnt > eom_result_count) {
+				pr_err("The count of data exceeds the maximum %d of the device\n", eom_result_count);
+				return ERROR;
+			}
+		}
+
+		ret = eom_stream_point(er);
+		if (ret)
+			return ret;
+	}
+
+	return SUCCESS;
+}
+
+/* Neither clearly open nor clearly closed */
+static bool eom_ambiguous(int *error_cnt)
+{
+	int l;
+
+	for (l = lane; l < lane + eom_nr_rx(); l++) {
+		if (error_cnt[l] > 0 && error_cnt[l] < EOM_PHY_ERROR_COUNT_THRESHOLD)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * eom_scan - Measure one point on all lanes and record the results
+ * @peer: LOCAL or PEER
+ * @timing: Timing offset in steps
+ * @volt: Voltage offset in steps
+ * @target_count: Target test count
+ * @quick_count: Lower target test count to try first, 0 to measure at
+ *		 @target_count only. The point is re-measured at @target_count
+ *		 if the error count of a lane is ambiguous.
+ */
+static int eom_scan(int peer, int timing, int volt, int target_count, int quick_count)
+{
+	struct EOMData *data = &eom_data;
+	int eom_tested_count[EOM_MAX_RX], eom_error_count[EOM_MAX_RX];
+	int count = quick_count && quick_count < target_count ? quick_count : target_count;
+	__u64 start = eom_now_ns();
+	int l, ret;
+
+	ret = eom_measure(peer, timing, volt, count, false, eom_error_count, eom_tested_count);
+	if (ret)
+		return ret;
+
+	if (count != target_count && eom_ambiguous(eom_error_count)) {
+		count = target_count;
+		ret = eom_measure(peer, timing, volt, count, false, eom_error_count, eom_tested_count);
+		if (ret)
+			return ret;
+		data->recount_cnt++;
+	}
+
+	/* A point lasts until every lane reached the error threshold or the target test count */
+	for (l = lane; l < lane + eom_nr_rx(); l++) {
+		if (eom_error_count[l] < EOM_PHY_ERROR_COUNT_THRESHOLD)
+			break;
+	}
+	if (l < lane + eom_nr_rx()) {
+		data->long_ns += eom_now_ns() - start;
+		data->long_cnt++;
+	} else {
+		data->short_ns += eom_now_ns() - start;
+		data->short_cnt++;
+	}
+	/* With a recount, the point took both measurements */
+	data->point_us = (eom_now_ns() - start) / 1000;
+
+	return eom_record(timing, volt, count, eom_error_count, eom_tested_count);
+}
+
+/* True if a lane measured open below the target test count has a neighbour with errors */
+static bool eom_open_at_boundary(struct EOMData *data, int timing, int volt)
+{
+	struct eom_result *er, *n;
+	int l, t, v;
+
+	for (l = lane; l < lane + eom_nr_rx(); l++) {
+		er = eom_result_at(data, l, timing, volt);
+		if (!(er->flags & EOM_RESULT_MEASURED) || er->error_cnt || er->target_cnt >= target_test_count)
+			continue;
+
+		for (t = timing - 1; t <= timing + 1; t++) {
+			for (v = volt - 1; v <= volt + 1; v++) {
+				if (t < timing_left || t > timing_right || v < voltage_low || v > voltage_high)
+					continue;
+
+				n = eom_result_at(data, l, t, v);
+				if (n->flags && n->error_cnt)
+					return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/*
+ * After a scan with --quick-target, points that looked open at the quick
+ * count may hide errors near the boundary. Re-measure them at the target
+ * test count, until no re-measured point uncovers a new boundary.
+ */
+static int eom_refine_boundary(int peer)
+{
+	struct EOMData *data = &eom_data;
+	bool refined;
+	int t, v, ret;
+
+	do {
+		refined = false;
+		for (t = timing_left; t <= timing_right; t++) {
+			for (v = voltage_low; v <= voltage_high; v++) {
+				if (!eom_open_at_boundary(data, t, v))
+					continue;
+
+				ret = eom_scan(peer, t, v, target_test_count, 0);
+				if (ret)
+					return ret;
+				data->recount_cnt++;
+				refined = true;
+			}
+		}
+	} while (refined);
+
+	return SUCCESS;
+}
+
+/*
+ * Re-measure every validate_stride-th point of the scan with a full Eye
+ * Monitor configuration and PMC, and compare with the incremental results.
+ */
+static int eom_validate(int peer, int target_count)
+{
+	struct EOMData *data = &eom_data;
+	int eom_tested_count[EOM_MAX_RX], eom_error_count[EOM_MAX_RX];
+	int i, t, v, l, compared = 0, mismatched = 0, max_diff = 0, diff;
+	struct eom_result *er;
+	int ret;
+
+	printf("Validating incremental results against full PMC mode...\n");
+
+	for (t = timing_left, i = 0; t <= timing_right; t++) {
+		for (v = voltage_low; v <= voltage_high; v++, i++) {
+			if (i % validate_stride)
+				continue;
+
+			/* Points inferred by the adaptive scan were not measured */
+			if (!(eom_result_at(data, lane, t, v)->flags & EOM_RESULT_MEASURED))
+				continue;
+
+			ret = eom_measure(peer, t, v, target_count, true, eom_error_count, eom_tested_count);
+			if (ret)
+				return ret;
+
+			for (l = lane; l < lane + eom_nr_rx(); l++) {
+				er = eom_result_at(data, l, t, v);
+				compared++;
+				diff = abs(eom_error_count[l] - er->error_cnt);
+				if (diff > max_diff)
+					max_diff = diff;
+
+				/* Open (no error) vs. closed must agree, counts are statistical */
+				if (!eom_error_count[l] != !er->error_cnt) {
+					mismatched++;
+					printf("Mismatch %slane: %d timing: %d voltage: %d error count: %d (incremental) vs %d (full)\n",
+					       both ? (eom_rx_slot(l) ? "device " : "host ") : "", eom_rx_lane(l), t, v,
+					       er->error_cnt, eom_error_count[l]);
+				}
+			}
+		}
+	}
+
+	printf("Validation: %d points compared, %d open/closed mismatches, max error count difference %d\n",
+	       compared, mismatched, max_diff);
+
+	return SUCCESS;
+}
+
+/*
+ * Adaptive scan: a line is a row (fixed voltage, position is timing) or a
+ * column (fixed timing, position is voltage). The eye is assumed to be one
+ * open region around its center, so each line crossing it has one open
+ * interval whose ends are found by bisection, or by walking from the ends
+ * found on the neighbouring line when tracing the contour.
+ */
+static int eom_line_open(int peer, int l, bool row, int fixed, int pos, bool *open)
+{
+	int timing = row ? pos : fixed;
+	int volt = row ? fixed : pos;
+	struct eom_result *er = eom_result_at(&eom_data, l, timing, volt);
+	int ret;
+
+	/* All lanes are measured at once, a point may already be known from another lane */
+	if (!(er->flags & EOM_RESULT_MEASURED)) {
+		ret = eom_scan(peer, timing, volt, target_test_count, quick_target);
+		if (ret)
+			return ret;
+	}
+
+	*open = !er->error_cnt;
+
+	return SUCCESS;
+}
+
+/**
+ * eom_find_edge - Find the last open position of a line
+ * @peer: LOCAL or PEER
+ * @l: Lane
+ * @row: Row or column
+ * @fixed: Voltage of a row, timing of a column
+ * @inner: Known open position
+ * @limit: Last position of the line in the search direction
+ * @guess: Edge found on the neighbouring line, EOM_TIMING_VOLTAGE_INIT to bisect
+ * @edge: Output last open position from @inner towards @limit
+ */
+static int eom_find_edge(int peer, int l, bool row, int fixed, int inner, int limit, int guess, int *edge)
+{
+	int dir = limit >= inner ? 1 : -1;
+	int lo = inner, hi = limit, mid, ret;
+	bool open;
+
+	if (guess != EOM_TIMING_VOLTAGE_INIT) {
+		if ((guess - inner) * dir < 0)
+			guess = inner;
+		if ((guess - limit) * dir > 0)
+			guess = limit;
+
+		ret = eom_line_open(peer, l, row, fixed, guess, &open);
+		if (ret)
+			return ret;
+
+		if (open) {
+			/* Walk outwards until the next position is closed */
+			while (guess != limit) {
+				ret = eom_line_open(peer, l, row, fixed, guess + dir, &open);
+				if (ret)
+					return ret;
+				if (!open)
+					break;
+				guess += dir;
+			}
+		} else {
+			/* Walk inwards until open, @inner is known open */
+			while (guess != inner) {
+				guess -= dir;
+				ret = eom_line_open(peer, l, row, fixed, guess, &open);
+				if (ret)
+					return ret;
+				if (open)
+					break;
+			}
+		}
+
+		*edge = guess;
+		return SUCCESS;
+	}
+
+	ret = eom_line_open(peer, l, row, fixed, limit, &open);
+	if (ret)
+		return ret;
+
+	if (!open) {
+		/* lo is open, hi is closed */
+		while (abs(hi - lo) > 1) {
+			mid = lo + (hi - lo) / 2;
+			ret = eom_line_open(peer, l, row, fixed, mid, &open);
+			if (ret)
+				return ret;
+			if (open)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		limit = lo;
+	}
+
+	*edge = limit;
+
+	return SUCCESS;
+}
+
+/* Measure guard_band positions on both sides of an edge, @dir points outwards */
+static int eom_guard_edge(int peer, int l, bool row, int fixed, int edge, int dir)
+{
+	int first = row ? timing_left : voltage_low;
+	int last = row ? timing_right : voltage_high;
+	int k, pos, ret;
+	bool open;
+
+	for (k = 1 - guard_band; k <= guard_band; k++) {
+		pos = edge + k * dir;
+		if (pos < first || pos > last)
+			continue;
+
+		ret = eom_line_open(peer, l, row, fixed, pos, &open);
+		if (ret)
+			return ret;
+	}
+
+	return SUCCESS;
+}
+
+/**
+ * eom_trace - Trace the eye contour on one side of the center
+ * @peer: LOCAL or PEER
+ * @l: Lane
+ * @row: Trace rows (upper/lower contour) or columns (left/right contour)
+ * @center: Position to start from on the first line
+ * @start: First line
+ * @dir: Line increment, 1 or -1
+ * @lo: Output first open position of each line, EOM_TIMING_VOLTAGE_INIT if closed
+ * @hi: Output last open position of each line
+ *
+ * Tracing stops at the first line whose middle, taken from the open interval
+ * of the previous line, is closed.
+ */
+static int eom_trace(int peer, int l, bool row, int center, int start, int dir, int *lo, int *hi)
+{
+	int first = row ? voltage_low : timing_left;
+	int last = row ? voltage_high : timing_right;
+	int pos_first = row ? timing_left : voltage_low;
+	int pos_last = row ? timing_right : voltage_high;
+	int lo_guess = EOM_TIMING_VOLTAGE_INIT, hi_guess = EOM_TIMING_VOLTAGE_INIT;
+	int fixed, mid = center, ret;
+	bool open;
+
+	for (fixed = start; fixed >= first && fixed <= last; fixed += dir) {
+		ret = eom_line_open(peer, l, row, fixed, mid, &open);
+		if (ret)
+			return ret;
+		if (!open)
+			break;
+
+		ret = eom_find_edge(peer, l, row, fixed, mid, pos_first, lo_guess, &lo[fixed - first]);
+		if (ret)
+			return ret;
+
+		ret = eom_find_edge(peer, l, row, fixed, mid, pos_last, hi_guess, &hi[fixed - first]);
+		if (ret)
+			return ret;
+
+		lo_guess = lo[fixed - first];
+		hi_guess = hi[fixed - first];
+		mid = lo_guess + (hi_guess - lo_guess) / 2;
+
+		if (guard_band) {
+			ret = eom_guard_edge(peer, l, row, fixed, lo_guess, -1);
+			if (ret)
+				return ret;
+
+			ret = eom_guard_edge(peer, l, row, fixed, hi_guess, 1);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return SUCCESS;
+}
+
+static int eom_adaptive_scan(int peer, int l)
+{
+	struct EOMData *data = &eom_data;
+	int nt = timing_right - timing_left + 1;
+	int nv = voltage_high - voltage_low + 1;
+	int *row_lo, *row_hi, *col_lo, *col_hi;
+	int tc, vc, t, v, i, ret;
+	bool open, row_open, col_open;
+	struct eom_result *er;
+
+	row_lo = malloc(2 * (nt + nv) * sizeof(int));
+	if (!row_lo) {
+		pr_err("Failed to allocate memory for adaptive scan\n");
+		return ERROR;
+	}
+	row_hi = row_lo + nv;
+	col_lo = row_hi + nv;
+	col_hi = col_lo + nt;
+	for (i = 0; i < 2 * (nt + nv); i++)
+		row_lo[i] = EOM_TIMING_VOLTAGE_INIT;
+
+	/* Eye center, or the nearest point of the scan range */
+	tc = timing_left > 0 ? timing_left : (timing_right < 0 ? timing_right : 0);
+	vc = voltage_low > 0 ? voltage_low : (voltage_high < 0 ? voltage_high : 0);
+
+	ret = eom_line_open(peer, l, true, vc, tc, &open);
+	if (ret)
+		goto out;
+
+	if (!open) {
+		printf("Lane %d: eye center is closed, scanning the full grid\n", l);
+		for (t = timing_left; t <= timing_right; t++) {
+			for (v = voltage_low; v <= voltage_high; v++) {
+				ret = eom_line_open(peer, l, true, v, t, &open);
+				if (ret)
+					goto out;
+			}
+		}
+		goto out;
+	}
+
+	/* Upper and lower contour row by row, then left and right contour column by column */
+	ret = eom_trace(peer, l, true, tc, vc, 1, row_lo, row_hi);
+	if (!ret)
+		ret = eom_trace(peer, l, true, tc, vc - 1, -1, row_lo, row_hi);
+	if (!ret)
+		ret = eom_trace(peer, l, false, vc, tc, 1, col_lo, col_hi);
+	if (!ret)
+		ret = eom_trace(peer, l, false, vc, tc - 1, -1, col_lo, col_hi);
+	if (ret)
+		goto out;
+
+	/* Measure where rows and columns disagree, infer the remaining points */
+	for (t = timing_left; t <= timing_right; t++) {
+		for (v = voltage_low; v <= voltage_high; v++) {
+			er = eom_result_at(data, l, t, v);
+			if (er->flags & EOM_RESULT_MEASURED)
+				continue;
+
+			i = v - voltage_low;
+			row_open = row_lo[i] != EOM_TIMING_VOLTAGE_INIT && t >= row_lo[i] && t <= row_hi[i];
+			i = t - timing_left;
+			col_open = col_lo[i] != EOM_TIMING_VOLTAGE_INIT && v >= col_lo[i] && v <= col_hi[i];
+
+			if (row_open != col_open) {
+				ret = eom_line_open(peer, l, true, v, t, &open);
+				if (ret)
+					goto out;
+				continue;
+			}
+
+			er->lane = l;
+			er->timing = t;
+			er->volt = v;
+			er->error_cnt = row_open ? 0 : EOM_PHY_ERROR_COUNT_THRESHOLD;
+			er->flags = EOM_RESULT_INFERRED;
+			data->inferred_cnt++;
+		}
+	}
+
+out:
+	free(row_lo);
+
+	return ret;
+}
+
+/*
+ * Step sizes as in ufs-eom-plot.py, RX_EYEMON_Timing_MAX_Offset is in 0.01 UI
+ * and RX_EYEMON_Voltage_MAX_Offset in 10 mV.
+ */
+static double eom_timing_step_ui(struct EOMData *data)
+{
+	return data->timing_max_offset * 0.01 / data->timing_max_steps;
+}
+
+static double eom_voltage_step_mv(struct EOMData *data)
+{
+	return data->voltage_max_offset * 10.0 / data->voltage_max_steps;
+}
+
+/* Eye mask: a diamond around the eye center, with the same eye width and height as ufs-eom-plot.py */
+static void eom_mask_steps(struct EOMData *data, double *width_ui, double *half_mv, double *hw, double *hh)
+{
+	*width_ui = data->gear >= 5 ? EOM_MASK_G5_WIDTH_UI : EOM_MASK_G4_WIDTH_UI;
+	*half_mv = data->gear >= 5 ? EOM_MASK_G5_HALF_HEIGHT_MV : EOM_MASK_G4_HALF_HEIGHT_MV;
+	*hw = *width_ui / 2 / eom_timing_step_ui(data);
+	*hh = *half_mv / eom_voltage_step_mv(data);
+}
+
+/**
+ * eom_mask_test - Check the eye mask scaled to @hw x @hh steps on one lane
+ * @peer: LOCAL or PEER
+ * @l: Lane
+ * @center: Timing of the eye center
+ * @hw: Half width of the mask in timing steps
+ * @hh: Half height of the mask in voltage steps
+ * @pass: Output, true if the whole outline of the mask is open
+ *
+ * Only the grid points on the outline of the mask are measured, the inside
+ * of the eye is open if its outline is. Returns INIT if the mask does not
+ * fit the scan range.
+ */
+static int eom_mask_test(int peer, int l, int center, double hw, double hh, bool *pass)
+{
+	int w = (int)hw, h = (int)hh;
+	int dt, dv, next, st, sv, ret;
+	bool open;
+
+	if (center - w < timing_left || center + w > timing_right || -h < voltage_low || h > voltage_high)
+		return INIT;
+
+	/* From the timing corners inwards, each column down to the next column's outline */
+	for (dt = w; dt >= 0; dt--) {
+		dv = (int)(hh * (1 - dt / hw));
+		next = dt < w ? (int)(hh * (1 - (dt + 1) / hw)) : -1;
+
+		for (; dv > next; dv--) {
+			for (st = -1; st <= 1; st += 2) {
+				for (sv = -1; sv <= 1; sv += 2) {
+					ret = eom_line_open(peer, l, true, sv * dv, center + st * dt, &open);
+					if (ret)
+						return ret;
+					if (!open) {
+						*pass = false;
+						return SUCCESS;
+					}
+				}
+			}
+		}
+	}
+
+	*pass = true;
+
+	return SUCCESS;
+}
+
+static int eom_mask_lane(int peer, int l, bool *pass)
+{
+	struct EOMData *data = &eom_data;
+	double width_ui, half_mv, hw, hh, lo, hi, mid, scale;
+	int left, right, center, tc, ret;
+	bool open, limited = false;
+
+	eom_mask_steps(data, &width_ui, &half_mv, &hw, &hh);
+
+	/* Eye center on the zero voltage row, as ufs-eom-plot.py does */
+	tc = timing_left > 0 ? timing_left : (timing_right < 0 ? timing_right : 0);
+	ret = eom_line_open(peer, l, true, 0, tc, &open);
+	if (ret)
+		return ret;
+
+	if (!open) {
+		printf("Lane %d: eye mask FAIL, eye is closed at timing %d voltage 0\n", l, tc);
+		*pass = false;
+		return SUCCESS;
+	}
+
+	ret = eom_find_edge(peer, l, true, 0, tc, timing_left, EOM_TIMING_VOLTAGE_INIT, &left);
+	if (!ret)
+		ret = eom_find_edge(peer, l, true, 0, tc, timing_right, EOM_TIMING_VOLTAGE_INIT, &right);
+	if (ret)
+		return ret;
+
+	center = left + (right - left + 1) / 2;
+
+	ret = eom_mask_test(peer, l, center, hw, hh, pass);
+	if (ret == INIT) {
+		pr_err("Lane %d: eye mask (%.1f x %.1f steps around timing %d) does not fit the scan range\n",
+		       l, 2 * hw, 2 * hh, center);
+		return ERROR;
+	} else if (ret) {
+		return ret;
+	}
+
+	if (!mask_margin) {
+		printf("Lane %d: eye mask %s, eye center at timing %d\n", l, *pass ? "PASS" : "FAIL", center);
+		return SUCCESS;
+	}
+
+	/* Largest scale whose mask fits the scan range */
+	hi = (double)(center - timing_left < timing_right - center ? center - timing_left : timing_right - center) / hw;
+	mid = (double)(-voltage_low < voltage_high ? -voltage_low : voltage_high) / hh;
+	if (mid < hi)
+		hi = mid;
+
+	if (*pass) {
+		lo = 1;
+		ret = eom_mask_test(peer, l, center, hw * hi, hh * hi, &open);
+		if (ret && ret != INIT)
+			return ret;
+		if (!ret && open) {
+			lo = hi;
+			limited = true;
+		}
+	} else {
+		hi = 1;
+		lo = 0;
+	}
+
+	while (hi - lo > EOM_MASK_SCALE_RESOLUTION) {
+		mid = (lo + hi) / 2;
+		ret = eom_mask_test(peer, l, center, hw * mid, hh * mid, &open);
+		if (ret && ret != INIT)
+			return ret;
+		if (!ret && open)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	scale = lo;
+	printf("Lane %d: eye mask %s, eye center at timing %d, margin scale %s%.2f, timing margin %+.1f ps, voltage margin %+.1f mV\n",
+	       l, *pass ? "PASS" : "FAIL", center, limited ? ">=" : "", scale,
+	       (scale - 1) * width_ui * eom_ui_ps(data), (scale - 1) * 2 * half_mv);
+
+	return SUCCESS;
+}
+
+static int eom_mask_scan(int peer, bool *failed)
+{
+	struct EOMData *data = &eom_data;
+	bool pass;
+	int l, ret;
+
+	for (l = lane; l < lane + data->num_lanes; l++) {
+		ret = eom_mask_lane(peer, l, &pass);
+		if (ret)
+			return ret;
+		if (!pass)
+			*failed = true;
+	}
+
+	printf("Eye mask: %d points measured\n", data->data_cnt / data->num_lanes);
+
+	return SUCCESS;
+}
+
+/* Q such that 0.5 * erfc(Q / sqrt(2)) = p, for 0 < p < 0.5 */
+static double eom_q_of(double p)
+{
+	double lo = 0, hi = 40, mid;
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		mid = (lo + hi) / 2;
+		if (0.5 * erfc(mid / M_SQRT2) > p)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return (lo + hi) / 2;
+}
+
+/* Measure a row (@axis 0) or column (@axis 1) at every level for the lanes whose bathtub is on it */
+static int eom_bathtub_line(int peer, int axis, int fixed, int *levels, int nr_levels)
+{
+	struct EOMData *data = &eom_data;
+	int eom_tested_count[EOM_MAX_LANES], eom_error_count[EOM_MAX_LANES];
+	int first = axis ? voltage_low : timing_left;
+	int last = axis ? voltage_high : timing_right;
+	int pos, t, v, i, l, ret;
+	struct eom_bathtub_sample *bs;
+	struct eom_bathtub *bt;
+
+	for (pos = first; pos <= last; pos++) {
+		t = axis ? fixed : pos;
+		v = axis ? pos : fixed;
+
+		for (i = 0; i < nr_levels; i++) {
+			ret = eom_measure(peer, t, v, levels[i], false, eom_error_count, eom_tested_count);
+			if (ret)
+				return ret;
+
+			/* The target test count level also goes into the regular report */
+			if (levels[i] == target_test_count &&
+			    !(eom_result_at(data, lane, t, v)->flags & EOM_RESULT_MEASURED)) {
+				ret = eom_record(t, v, levels[i], eom_error_count, eom_tested_count);
+				if (ret)
+					return ret;
+			}
+
+			for (l = lane; l < lane + data->num_lanes; l++) {
+				bt = &data->bathtub[l][axis];
+				if (bt->line != fixed)
+					continue;
+
+				bs = &bt->samples[bt->nr_samples++];
+				bs->pos = pos;
+				bs->target_cnt = levels[i];
+				bs->error_cnt = eom_error_count[l];
+				bs->tested_cnt = eom_tested_count[l];
+			}
+		}
+	}
+
+	return SUCCESS;
+}
+
+/*
+ * Dual-Dirac fit of both slopes: the BER of a slope point, over the
+ * transition density, is converted to Q and the slope position is taken as
+ * linear in Q, pos = mu + b * Q. Points without errors carry no Q and points
+ * at BER over half the transition density are beyond the slope.
+ */
+static void eom_bathtub_fit(struct eom_bathtub *bt, double q_target)
+{
+	double sx, sy, sxx, sxy, q, p, b, denom;
+	struct eom_bathtub_sample *bs;
+	int side, i, n, d;
+
+	for (side = 0; side < 2; side++) {
+		sx = sy = sxx = sxy = 0;
+		n = 0;
+
+		for (i = 0; i < bt->nr_samples; i++) {
+			bs = &bt->samples[i];
+			d = bs->pos - bt->center;
+			if ((side && d <= 0) || (!side && d >= 0) || !bs->error_cnt || !bs->tested_cnt)
+				continue;
+
+			p = bs->error_cnt / eom_tested_uis(bs->tested_cnt) / EOM_BATHTUB_TRANSITION_DENSITY;
+			if (p >= 0.5)
+				continue;
+
+			q = eom_q_of(p);
+			sx += q;
+			sy += bs->pos;
+			sxx += q * q;
+			sxy += q * bs->pos;
+			n++;
+		}
+
+		denom = n * sxx - sx * sx;
+		bt->fitted[side] = false;
+		if (n < 2 || fabs(denom) < 1e-9)
+			continue;
+
+		/* The slope has to close towards the outside of the eye */
+		b = (n * sxy - sx * sy) / denom;
+		if ((side && b >= 0) || (!side && b <= 0))
+			continue;
+
+		bt->mu[side] = (sy - b * sx) / n;
+		bt->sigma[side] = fabs(b);
+		bt->edge[side] = bt->mu[side] + b * q_target;
+		bt->fitted[side] = true;
+	}
+}
+
+/* Opening at the target BER in steps, or a negative value if it cannot be extrapolated */
+static double eom_bathtub_opening(struct eom_bathtub *bt)
+{
+	if (!bt->fitted[0] || !bt->fitted[1])
+		return -1;
+
+	return bt->edge[1] > bt->edge[0] ? bt->edge[1] - bt->edge[0] : 0;
+}
+
+/*
+ * Bathtub scan: measure the zero voltage row, find the eye center of each
+ * lane on it as ufs-eom-plot.py does, then measure the column through each
+ * center. Every point is measured at the target test count and at lower
+ * levels, so that the slopes reach down to lower BERs.
+ */
+static int eom_bathtub_scan(int peer)
+{
+	struct EOMData *data = &eom_data;
+	int nt = timing_right - timing_left + 1;
+	int nv = voltage_high - voltage_low + 1;
+	int levels[EOM_BATHTUB_LEVELS], nr_levels = 0;
+	int l, k, t, tc, left, right, axis, ret;
+	double q_target, width, height;
+	struct eom_bathtub *bt;
+
+	if (voltage_low > 0 || voltage_high < 0) {
+		pr_err("Bathtub curves need voltage 0 in the scan range\n");
+		return ERROR;
+	}
+
+	for (k = target_test_count; k > 0 && nr_levels < EOM_BATHTUB_LEVELS; k -= EOM_BATHTUB_LEVEL_STEP)
+		levels[nr_levels++] = k;
+
+	for (l = lane; l < lane + data->num_lanes; l++) {
+		for (axis = 0; axis < 2; axis++) {
+			bt = &data->bathtub[l][axis];
+			bt->samples = calloc(EOM_BATHTUB_LEVELS * (nt > nv ? nt : nv), sizeof(*bt->samples));
+			if (!bt->samples) {
+				pr_err("Failed to allocate memory for bathtub curves\n");
+				return ERROR;
+			}
+			bt->line = axis ? EOM_TIMING_VOLTAGE_INIT : 0;
+		}
+	}
+
+	ret = eom_bathtub_line(peer, 0, 0, levels, nr_levels);
+	if (ret)
+		return ret;
+
+	tc = timing_left > 0 ? timing_left : (timing_right < 0 ? timing_right : 0);
+	for (l = lane; l < lane + data->num_lanes; l++) {
+		bt = &data->bathtub[l][0];
+		bt->center = tc;
+		if (eom_result_at(data, l, tc, 0)->error_cnt) {
+			printf("Lane %d: eye is closed at timing %d voltage 0\n", l, tc);
+			continue;
+		}
+
+		for (right = tc; right < timing_right && !eom_result_at(data, l, right + 1, 0)->error_cnt; right++)
+			;
+		for (left = tc; left > timing_left && !eom_result_at(data, l, left - 1, 0)->error_cnt; left--)
+			;
+
+		bt->center = left + (right - left + 1) / 2;
+		data->bathtub[l][1].line = bt->center;
+		data->bathtub[l][1].center = 0;
+	}
+
+	for (l = lane; l < lane + data->num_lanes; l++) {
+		t = data->bathtub[l][1].line;
+		if (t == EOM_TIMING_VOLTAGE_INIT)
+			continue;
+
+		/* Lanes with the same center share the column */
+		for (k = lane; k < l && data->bathtub[k][1].line != t; k++)
+			;
+		if (k < l)
+			continue;
+
+		ret = eom_bathtub_line(peer, 1, t, levels, nr_levels);
+		if (ret)
+			return ret;
+	}
+
+	q_target = eom_q_of(EOM_BATHTUB_TARGET_BER / EOM_BATHTUB_TRANSITION_DENSITY);
+	for (l = lane; l < lane + data->num_lanes; l++) {
+		for (axis = 0; axis < 2; axis++)
+			eom_bathtub_fit(&data->bathtub[l][axis], q_target);
+
+		width = eom_bathtub_opening(&data->bathtub[l][0]);
+		height = eom_bathtub_opening(&data->bathtub[l][1]);
+		printf("Lane %d: at BER %.0e eye width ", l, EOM_BATHTUB_TARGET_BER);
+		if (width < 0)
+			printf("n/a");
+		else
+			printf("%.3f UI (%.1f ps)", width * eom_timing_step_ui(data),
+			       width * eom_timing_step_ui(data) * eom_ui_ps(data));
+		printf(", eye height ");
+		if (height < 0)
+			printf("n/a\n");
+		else
+			printf("%.1f mV\n", height * eom_voltage_step_mv(data));
+	}
+
+	return SUCCESS;
+}
+
+/* Bathtub sections, no line has more than 7 fields so that ufs-eom-plot.py skips them */
+static void eom_bathtub_report(FILE *file, struct EOMData *data)
+{
+	struct eom_bathtub_sample *bs;
+	struct eom_bathtub *bt;
+	double opening;
+	int l, axis, side, i;
+
+	for (l = lane; l < lane + data->num_lanes; l++) {
+		for (axis = 0; axis < 2; axis++) {
+			bt = &data->bathtub[l][axis];
+			if (bt->line == EOM_TIMING_VOLTAGE_INIT)
+				continue;
+
+			fprintf(file, "\nBathtub %s Lane %d Line %d\n", axis ? "Voltage" : "Timing", l, bt->line);
+			fprintf(file, "position target errors tested ber\n");
+			for (i = 0; i < bt->nr_samples; i++) {
+				bs = &bt->samples[i];
+				fprintf(file, "%d %d %d %d %.3e\n", bs->pos, bs->target_cnt, bs->error_cnt, bs->tested_cnt,
+					bs->tested_cnt ? bs->error_cnt / eom_tested_uis(bs->tested_cnt) : 0);
+			}
+
+			for (side = 0; side < 2; side++) {
+				if (bt->fitted[side])
+					fprintf(file, "Fit %s mu %.2f sigma %.2f\n", side ? (axis ? "upper" : "right") :
+					       (axis ? "lower" : "left"), bt->mu[side], bt->sigma[side]);
+			}
+
+			opening = eom_bathtub_opening(bt);
+			if (opening < 0)
+				fprintf(file, "%s@%.0e n/a\n", axis ? "Height" : "Width", EOM_BATHTUB_TARGET_BER);
+			else if (axis)
+				fprintf(file, "Height@%.0e %.2f steps %.1f mV\n", EOM_BATHTUB_TARGET_BER, opening,
+					opening * eom_voltage_step_mv(data));
+			else
+				fprintf(file, "Width@%.0e %.2f steps %.4f UI %.1f ps\n", EOM_BATHTUB_TARGET_BER, opening,
+					opening * eom_timing_step_ui(data), opening * eom_timing_step_ui(data) * eom_ui_ps(data));
+		}
+	}
+}
+
+/*
+ * Scan planner calibration: time a few UIC commands, then measure the eye
+ * center of each lane and bisect its extents on the center row and column.
+ * These points run both to the target test count (inside the eye) and to
+ * the error threshold (outside), which gives both point durations.
+ */
+static int eom_plan_calibrate(int peer, struct eom_plan *plan)
+{
+	struct EOMData *data = &eom_data;
+	int tc, vc, l, i, ret;
+	__u64 start, first_ns = 0;
+	bool open;
+
+	start = eom_now_ns();
+	for (i = 0; i < EOM_PLAN_CMD_SAMPLES; i++) {
+		ret = uic_get(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_CAPABILITY, SELECT_RX(lane)), peer);
+		if (ret < 0) {
+			pr_err("Failed to read RX_EYEMON_Capability\n");
+			return ERROR;
+		}
+	}
+	plan->cmd_us = (eom_now_ns() - start) / 1000.0 / EOM_PLAN_CMD_SAMPLES;
+
+	tc = timing_left > 0 ? timing_left : (timing_right < 0 ? timing_right : 0);
+	vc = voltage_low > 0 ? voltage_low : (voltage_high < 0 ? voltage_high : 0);
+
+	for (l = lane; l < lane + data->num_lanes; l++) {
+		ret = eom_line_open(peer, l, true, vc, tc, &open);
+		if (ret)
+			return ret;
+
+		if (l == lane && open)
+			first_ns = data->long_ns;
+
+		plan->eye[l] = open;
+		if (!open)
+			continue;
+
+		ret = eom_find_edge(peer, l, true, vc, tc, timing_left, EOM_TIMING_VOLTAGE_INIT, &plan->left[l]);
+		if (!ret)
+			ret = eom_find_edge(peer, l, true, vc, tc, timing_right, EOM_TIMING_VOLTAGE_INIT, &plan->right[l]);
+		if (!ret)
+			ret = eom_find_edge(peer, l, false, tc, vc, voltage_low, EOM_TIMING_VOLTAGE_INIT, &plan->low[l]);
+		if (!ret)
+			ret = eom_find_edge(peer, l, false, tc, vc, voltage_high, EOM_TIMING_VOLTAGE_INIT, &plan->high[l]);
+		if (ret)
+			return ret;
+	}
+
+	/*
+	 * The first point includes arming the Eye Monitor, which a full scan
+	 * pays once, so it is dropped when there are other long points.
+	 */
+	plan->short_s = data->short_cnt ? data->short_ns / 1e9 / data->short_cnt : 0;
+	if (first_ns && data->long_cnt > 1)
+		plan->long_s_per_ui = (data->long_ns - first_ns) / 1e9 / (data->long_cnt - 1);
+	else
+		plan->long_s_per_ui = data->long_cnt ? data->long_ns / 1e9 / data->long_cnt : 0;
+	plan->long_s_per_ui = plan->long_s_per_ui > plan->short_s ? plan->long_s_per_ui - plan->short_s : 0;
+	plan->long_s_per_ui /= eom_tested_uis(target_test_count);
+
+	return SUCCESS;
+}
+
+/* True if a point is inside the eye of a lane, widened by one step for the slope */
+static bool eom_plan_long(struct eom_plan *plan, int l, int timing, int volt)
+{
+	int tc = timing_left > 0 ? timing_left : (timing_right < 0 ? timing_right : 0);
+	int vc = voltage_low > 0 ? voltage_low : (voltage_high < 0 ? voltage_high : 0);
+	double w, h;
+
+	/* Without an eye, assume the worst */
+	if (!plan->eye[l])
+		return true;
+
+	w = timing >= tc ? plan->right[l] - tc + 1 : tc - plan->left[l] + 1;
+	h = volt >= vc ? plan->high[l] - vc + 1 : vc - plan->low[l] + 1;
+
+	return abs(timing - tc) / w + abs(volt - vc) / h <= 1;
+}
+
+/* Predict the duration of a grid scan with the given stride, target test count and lanes */
+static double eom_plan_predict(struct eom_plan *plan, int stride, int target_cnt, int num_lanes, int *nr_points)
+{
+	double lane_factor = (double)num_lanes / eom_data.num_lanes;
+	double seconds = 0, point_s;
+	int t, v, l;
+	bool is_long;
+
+	*nr_points = 0;
+	for (t = timing_left; t <= timing_right; t++) {
+		for (v = voltage_low; v <= voltage_high; v++) {
+			if (t % stride || v % stride)
+				continue;
+
+			is_long = false;
+			for (l = lane; l < lane + num_lanes && !is_long; l++)
+				is_long = eom_plan_long(plan, l, t, v);
+
+			/* Commands scale with the lanes, tests run on all lanes at once */
+			point_s = plan->short_s * lane_factor;
+			if (is_long)
+				point_s += plan->long_s_per_ui * eom_tested_uis(target_cnt);
+
+			seconds += point_s;
+			(*nr_points)++;
+		}
+	}
+
+	return seconds;
+}
+
+/*
+ * Pick the plan that fits the budget, preferring all lanes over one lane,
+ * then a finer stride, then a higher target test count. If nothing fits,
+ * the fastest plan is used.
+ */
+static void eom_plan_pick(struct eom_plan *plan)
+{
+	struct EOMData *data = &eom_data;
+	int stride, count, num_lanes, nr_points;
+	double seconds;
+
+	plan->seconds = -1;
+	for (num_lanes = data->num_lanes; num_lanes > 0; num_lanes--) {
+		for (stride = 1; stride <= EOM_PLAN_MAX_STRIDE; stride++) {
+			for (count = target_test_count; count >= EOM_PLAN_MIN_TARGET || count == target_test_count;
+			     count -= EOM_PLAN_TARGET_STEP) {
+				seconds = eom_plan_predict(plan, stride, count, num_lanes, &nr_points);
+				if (seconds > budget && plan->seconds >= 0 && seconds >= plan->seconds)
+					continue;
+
+				plan->stride = stride;
+				plan->target_cnt = count;
+				plan->num_lanes = num_lanes;
+				plan->nr_points = nr_points;
+				plan->seconds = seconds;
+				if (seconds <= budget)
+					return;
+			}
+		}
+	}
+}
+
+static int eom_plan_scan(int peer, double *predicted)
+{
+	struct EOMData *data = &eom_data;
+	struct eom_plan plan = {0};
+	int l, nr_points, ret;
+	double seconds;
+
+	ret = eom_plan_calibrate(peer, &plan);
+	if (ret)
+		return ret;
+
+	printf("Scan plan: command latency %.0f us, %.1f ms per point at the error threshold, %.1f ms per point at target test count %d\n",
+	       plan.cmd_us, plan.short_s * 1000,
+	       (plan.short_s + plan.long_s_per_ui * eom_tested_uis(target_test_count)) * 1000, target_test_count);
+	for (l = lane; l < lane + data->num_lanes; l++) {
+		if (plan.eye[l])
+			printf("Scan plan: lane %d eye from timing %d to %d, voltage %d to %d\n", l, plan.left[l],
+			       plan.right[l], plan.low[l], plan.high[l]);
+		else
+			printf("Scan plan: lane %d eye center is closed, assuming every point runs to the target test count\n", l);
+	}
+
+	seconds = eom_plan_predict(&plan, 1, target_test_count, data->num_lanes, &nr_points);
+	printf("Scan plan: full scan of %d points, target test count %d, %d lane(s), predicted %.0f s\n",
+	       nr_points, target_test_count, data->num_lanes, seconds);
+
+	*predicted = seconds;
+	if (!budget)
+		return SUCCESS;
+
+	eom_plan_pick(&plan);
+	printf("Scan plan: budget %d s, stride %d, target test count %d, %d lane(s), %d points, predicted %.0f s%s\n",
+	       budget, plan.stride, plan.target_cnt, plan.num_lanes, plan.nr_points, plan.seconds,
+	       plan.seconds > budget ? " (over budget, fastest plan)" : "");
+
+	*predicted = plan.seconds;
+	if (dry_run)
+		return SUCCESS;
+
+	/* Calibration points taken at another target test count or on dropped lanes are redone */
+	if (plan.target_cnt != target_test_count || plan.num_lanes != data->num_lanes) {
+		for (l = lane + plan.num_lanes; l < lane + data->num_lanes; l++)
+			uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_ENABLE, SELECT_RX(l)), ATTR_SET_NOR, 0, peer);
+
+		memset(data->er, 0, eom_result_count * sizeof(struct eom_result));
+		data->data_cnt = 0;
+	}
+
+	scan_stride = plan.stride;
+	target_test_count = plan.target_cnt;
+	data->num_lanes = plan.num_lanes;
+
+	return SUCCESS;
+}
+
+/* Nearest position on the stride grid within [first, last] */
+static int eom_stride_nearest(int pos, int first, int last)
+{
+	int d;
+
+	for (d = 0; d <= scan_stride; d++) {
+		if (pos - d >= first && !((pos - d) % scan_stride))
+			return pos - d;
+		if (pos + d <= last && !((pos + d) % scan_stride))
+			return pos + d;
+	}
+
+	return pos;
+}
+
+/* Points skipped by the stride take the error count of the nearest measured point */
+static void eom_fill_stride(void)
+{
+	struct EOMData *data = &eom_data;
+	struct eom_result *er, *near;
+	int t, v, l;
+
+	for (l = lane; l < lane + data->num_lanes; l++) {
+		for (t = timing_left; t <= timing_right; t++) {
+			for (v = voltage_low; v <= voltage_high; v++) {
+				er = eom_result_at(data, l, t, v);
+				if (er->flags)
+					continue;
+
+				near = eom_result_at(data, l, eom_stride_nearest(t, timing_left, timing_right),
+						     eom_stride_nearest(v, voltage_low, voltage_high));
+				if (!(near->flags & EOM_RESULT_MEASURED))
+					continue;
+
+				er->lane = l;
+				er->timing = t;
+				er->volt = v;
+				er->error_cnt = near->error_cnt;
+				er->flags = EOM_RESULT_INFERRED;
+				data->inferred_cnt++;
+			}
+		}
+	}
+}
+
+/* Fail if a header line of a report shows another side or gear */
+static int eom_check_report_header(const char *line, struct EOMData *data, const char *what)
+{
+	char side[16];
+	int gear;
+
+	if (sscanf(line, "UFS %15s Side Eye Monitor Start", side) == 1 &&
+	    strcmp(side, data->local_peer ? "Device" : "Host")) {
+		pr_err("%s report is for the %s side\n", what, side);
+		return ERROR;
+	}
+
+	if (sscanf(line, "- - - - UFS Gear Speed: HS-G%d", &gear) == 1 && gear != data->gear) {
+		pr_err("%s report was taken at HS-G%d, current gear is HS-G%d\n", what, gear, data->gear);
+		return ERROR;
+	}
+
+	return SUCCESS;
+}
+
+/*
+ * Read the points of a previous report that fall into the current lanes and
+ * scan range. The report must be of the same side and gear.
+ */
+static int load_seed_report(const char *path, struct EOMData *data)
+{
+	int l, t, v, e, i, n = 0;
+	char line[256];
+	FILE *file;
+
+	seed_err = malloc(eom_result_count * sizeof(int));
+	if (!seed_err) {
+		pr_err("Failed to allocate memory for seed report\n");
+		return ERROR;
+	}
+	for (i = 0; i < eom_result_count; i++)
+		seed_err[i] = -1;
+
+	file = fopen(path, "r");
+	if (!file) {
+		pr_err("Failed to open seed report %s\n", path);
+		return ERROR;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		if (eom_check_report_header(line, data, "Seed"))
+			goto err;
+
+		if (sscanf(line, "lane: %d timing: %d voltage: %d error count: %d", &l, &t, &v, &e) != 4)
+			continue;
+
+		if (l < lane || l >= lane + data->num_lanes || t < timing_left || t > timing_right ||
+		    v < voltage_low || v > voltage_high || e < 0)
+			continue;
+
+		seed_err[eom_result_index(l, t, v)] = e;
+		n++;
+	}
+
+	fclose(file);
+
+	if (!n) {
+		pr_err("No point of seed report %s is in the scan range\n", path);
+		return ERROR;
+	}
+
+	printf("Seed report: %d of %d points in the scan range\n", n, eom_result_count);
+
+	return SUCCESS;
+
+err:
+	fclose(file);
+	return ERROR;
+}
+
+/* True if a point of the seed differs in open/closed state from one within @band steps */
+static bool seed_in_band(int l, int timing, int volt, int band)
+{
+	int e = seed_err[eom_result_index(l, timing, volt)];
+	int t, v, n;
+
+	for (t = timing - band; t <= timing + band; t++) {
+		if (t < timing_left || t > timing_right)
+			continue;
+
+		for (v = volt - band; v <= volt + band; v++) {
+			if (v < voltage_low || v > voltage_high)
+				continue;
+
+			n = seed_err[eom_result_index(l, t, v)];
+			if (n >= 0 && !n != !e)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/* True if the measured open/closed state of a point differs from the seed on any lane */
+static bool seed_changed(struct EOMData *data, int timing, int volt)
+{
+	struct eom_result *er;
+	int l;
+
+	for (l = lane; l < lane + data->num_lanes; l++) {
+		er = eom_result_at(data, l, timing, volt);
+		if ((er->flags & EOM_RESULT_MEASURED) &&
+		    !er->error_cnt != !seed_err[eom_result_index(l, timing, volt)])
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Delta scan: measure the boundary band of the seed eye and the points the
+ * seed does not have, then keep measuring the neighbours of every point whose
+ * open/closed state changed until the changes are enclosed. Everything else
+ * is carried over from the seed.
+ */
+static int eom_delta_scan(int peer)
+{
+	struct EOMData *data = &eom_data;
+	int band = guard_band ? guard_band : 1;
+	int t, v, l, dt, dv, nt, nv, changed = 0, ret;
+	struct eom_result *er;
+	bool measure, expanded;
+
+	for (t = timing_left; t <= timing_right; t++) {
+		for (v = voltage_low; v <= voltage_high; v++) {
+			measure = false;
+			for (l = lane; l < lane + data->num_lanes && !measure; l++)
+				measure = seed_err[eom_result_index(l, t, v)] < 0 || seed_in_band(l, t, v, band);
+
+			/* Points taken over by --resume are not measured again */
+			if (measure && !eom_point_measured(data, t, v)) {
+				ret = eom_scan(peer, t, v, target_test_count, quick_target);
+				if (ret)
+					return ret;
+			}
+		}
+	}
+
+	do {
+		expanded = false;
+		for (t = timing_left; t <= timing_right; t++) {
+			for (v = voltage_low; v <= voltage_high; v++) {
+				if (!seed_changed(data, t, v))
+					continue;
+
+				for (dt = -1; dt <= 1; dt++) {
+					for (dv = -1; dv <= 1; dv++) {
+						nt = t + dt;
+						nv = v + dv;
+						if (nt < timing_left || nt > timing_right || nv < voltage_low || nv > voltage_high)
+							continue;
+						if (eom_result_at(data, lane, nt, nv)->flags & EOM_RESULT_MEASURED)
+							continue;
+
+						ret = eom_scan(peer, nt, nv, target_test_count, quick_target);
+						if (ret)
+							return ret;
+						expanded = true;
+					}
+				}
+			}
+		}
+	} while (expanded);
+
+	for (t = timing_left; t <= timing_right; t++) {
+		for (v = voltage_low; v <= voltage_high; v++) {
+			if (seed_changed(data, t, v))
+				changed++;
+
+			for (l = lane; l < lane + data->num_lanes; l++) {
+				er = eom_result_at(data, l, t, v);
+				if (er->flags & EOM_RESULT_MEASURED)
+					continue;
+
+				er->lane = l;
+				er->timing = t;
+				er->volt = v;
+				er->error_cnt = seed_err[eom_result_index(l, t, v)];
+				er->flags = EOM_RESULT_CARRIED;
+				data->carried_cnt++;
+			}
+		}
+	}
+
+	printf("Delta scan: %d points measured, %d carried over, %d changed open/closed state\n",
+	       data->data_cnt, data->carried_cnt, changed);
+
+	return SUCCESS;
+}
+
+/* Forget the results of the previous sweep, they are in eom_stats */
+static void eom_reset_sweep(struct EOMData *data)
+{
+	memset(data->er, 0, eom_result_count * sizeof(struct eom_result));
+	data->data_cnt = 0;
+	data->inferred_cnt = 0;
+	data->carried_cnt = 0;
+	data->recount_cnt = 0;
+}
+
+static void eom_stats_add(struct EOMData *data)
+{
+	struct eom_point_stats *st;
+	struct eom_result *er;
+	double delta;
+	int i;
+
+	for (i = 0; i < eom_result_count; i++) {
+		er = &data->er[i];
+		if (!er->flags)
+			continue;
+
+		st = &eom_stats[i];
+		if (!st->nr_sweeps || er->error_cnt < st->min)
+			st->min = er->error_cnt;
+		if (!st->nr_sweeps || er->error_cnt > st->max)
+			st->max = er->error_cnt;
+		if (er->error_cnt)
+			st->nr_fails++;
+
+		st->nr_sweeps++;
+		delta = er->error_cnt - st->mean;
+		st->mean += delta / st->nr_sweeps;
+		st->m2 += delta * (er->error_cnt - st->mean);
+	}
+}
+
+/*
+ * Report the worst error count of every point over all sweeps, so that a point
+ * closed in any sweep is closed in the eye diagram, and keep the inferred or
+ * carried tag only if the point was never measured.
+ */
+static void eom_stats_apply(struct EOMData *data)
+{
+	struct eom_result *er;
+	int i;
+
+	for (i = 0; i < eom_result_count; i++) {
+		er = &data->er[i];
+		if (!eom_stats[i].nr_sweeps)
+			continue;
+
+		if (!er->flags) {
+			er->lane = lane + i / ((timing_right - timing_left + 1) * (voltage_high - voltage_low + 1));
+			er->timing = timing_left + i / (voltage_high - voltage_low + 1) % (timing_right - timing_left + 1);
+			er->volt = voltage_low + i % (voltage_high - voltage_low + 1);
+			er->flags = EOM_RESULT_INFERRED;
+		}
+		er->error_cnt = eom_stats[i].max;
+	}
+}
+
+static void eom_stats_report(FILE *file, struct EOMData *data)
+{
+	struct eom_point_stats *st;
+	int l, t, v;
+
+	for (l = lane; l < lane + data->num_lanes; l++) {
+		fprintf(file, "\nRepeat Lane %d Sweeps %d\n", l, repeat);
+		fprintf(file, "timing voltage min max mean variance fail\n");
+		for (t = timing_left; t <= timing_right; t++) {
+			for (v = voltage_low; v <= voltage_high; v++) {
+				st = &eom_stats[eom_result_index(l, t, v)];
+				if (!st->nr_sweeps)
+					continue;
+
+				fprintf(file, "%d %d %d %d %.2f %.2f %.2f\n", t, v, st->min, st->max, st->mean,
+					st->nr_sweeps > 1 ? st->m2 / (st->nr_sweeps - 1) : 0,
+					(double)st->nr_fails / st->nr_sweeps);
+			}
+		}
+	}
+}
+
+/* Eye metrics need the whole eye and the step sizes, the eye mask and bathtub scans report their own */
+static bool eom_eye_valid(struct EOMData *data)
+{
+	return !mask && !bathtub && data->timing_max_offset && data->voltage_max_offset &&
+	       (!both || (data->peer_timing_max_offset && data->peer_voltage_max_offset));
+}
+
+static bool eom_eye_point_open(struct EOMData *data, int l, int t, int v)
+{
+	struct eom_result *er = eom_result_at(data, l, t, v);
+
+	return er->flags && !er->error_cnt;
+}
+
+/*
+ * Eye metrics of receiver @l from the results of the scan, without measuring
+ * anything: the eye width along the zero voltage row and its center, the eye
+ * height along the center column, the open area and the largest eye mask
+ * scale that passes, points not measured counting as closed. The mask is the
+ * diamond of eom_mask_lane() around the eye center at voltage @eye->mid.
+ */
+static void eom_eye_metrics(struct EOMData *data, int l, struct eom_eye *eye)
+{
+	int side = eom_slot_side(eom_rx_slot(l));
+	double width_ui, half_mv, hw, hh, d;
+	int t, v, lo, hi;
+
+	memset(eye, 0, sizeof(*eye));
+	eye->step_ui = eom_timing_max_offset(data, side) * 0.01 / data->timing_max_steps;
+	eye->step_mv = eom_voltage_max_offset(data, side) * 10.0 / data->voltage_max_steps;
+	eye->mid = voltage_low > 0 ? voltage_low : (voltage_high < 0 ? voltage_high : 0);
+	t = timing_left > 0 ? timing_left : (timing_right < 0 ? timing_right : 0);
+	if (!eom_eye_point_open(data, l, t, eye->mid))
+		return;
+
+	eye->open = true;
+	for (eye->left = t; eye->left > timing_left && eom_eye_point_open(data, l, eye->left - 1, eye->mid);)
+		eye->left--;
+	for (eye->right = t; eye->right < timing_right && eom_eye_point_open(data, l, eye->right + 1, eye->mid);)
+		eye->right++;
+	eye->center = eye->left + (eye->right - eye->left + 1) / 2;
+
+	for (t = eye->left; t <= eye->right; t++) {
+		for (lo = eye->mid; lo > voltage_low && eom_eye_point_open(data, l, t, lo - 1);)
+			lo--;
+		for (hi = eye->mid; hi < voltage_high && eom_eye_point_open(data, l, t, hi + 1);)
+			hi++;
+		eye->area += hi - lo + 1;
+		if (t == eye->center) {
+			eye->low = lo;
+			eye->high = hi;
+		}
+	}
+
+	/* Largest scale whose mask fits the scan range, lowered to the nearest closed point */
+	width_ui = data->gear >= 5 ? EOM_MASK_G5_WIDTH_UI : EOM_MASK_G4_WIDTH_UI;
+	half_mv = data->gear >= 5 ? EOM_MASK_G5_HALF_HEIGHT_MV : EOM_MASK_G4_HALF_HEIGHT_MV;
+	hw = width_ui / 2 / eye->step_ui;
+	hh = half_mv / eye->step_mv;
+	lo = eye->center - timing_left < timing_right - eye->center ? eye->center - timing_left :
+								     timing_right - eye->center;
+	hi = eye->mid - voltage_low < voltage_high - eye->mid ? eye->mid - voltage_low : voltage_high - eye->mid;
+	eye->scale = lo / hw < hi / hh ? lo / hw : hi / hh;
+	eye->limited = true;
+
+	for (t = timing_left; t <= timing_right; t++) {
+		for (v = voltage_low; v <= voltage_high; v++) {
+			d = abs(t - eye->center) / hw + abs(v - eye->mid) / hh;
+			if (d <= eye->scale && !eom_eye_point_open(data, l, t, v)) {
+				eye->scale = d;
+				eye->limited = false;
+			}
+		}
+	}
+}
+
+/* Mask verdict: a closed point on or inside the mask fails it, a mask beyond the scan range is not tested */
+static const char *eom_eye_mask_result(struct eom_eye *eye)
+{
+	if (eye->limited)
+		return eye->scale >= 1 ? "PASS" : "n/a";
+
+	return eye->scale > 1 ? "PASS" : "FAIL";
+}
+
+/* Eye metrics sections, no line has more than 7 fields so that ufs-eom-plot.py skips them */
+static void eom_eye_report(FILE *file, struct EOMData *data, int slot)
+{
+	double width_ui = data->gear >= 5 ? EOM_MASK_G5_WIDTH_UI : EOM_MASK_G4_WIDTH_UI;
+	double half_mv = data->gear >= 5 ? EOM_MASK_G5_HALF_HEIGHT_MV : EOM_MASK_G4_HALF_HEIGHT_MV;
+	int first = lane + slot * data->num_lanes, l;
+	struct eom_eye eye;
+
+	for (l = first; l < first + data->num_lanes; l++) {
+		eom_eye_metrics(data, l, &eye);
+		fprintf(file, "\nEye Lane %d\n", eom_rx_lane(l));
+		if (!eye.open) {
+			fprintf(file, "Closed\n");
+			continue;
+		}
+
+		fprintf(file, "Width %d steps %.4f UI %.1f ps\n", eye.right - eye.left + 1,
+			(eye.right - eye.left + 1) * eye.step_ui, (eye.right - eye.left + 1) * eye.step_ui * eom_ui_ps(data));
+		fprintf(file, "Height %d steps %.1f mV\n", eye.high - eye.low + 1, (eye.high - eye.low + 1) * eye.step_mv);
+		fprintf(file, "Center %d steps %.4f UI %.1f mV\n", eye.center, eye.center * eye.step_ui,
+			(eye.low + eye.high) / 2.0 * eye.step_mv);
+		fprintf(file, "Area %d points %.3f UI*mV\n", eye.area, eye.area * eye.step_ui * eye.step_mv);
+		fprintf(file, "Mask %s scale %s%.2f\n", eom_eye_mask_result(&eye), eye.limited ? ">=" : "", eye.scale);
+		fprintf(file, "Margin %+.1f ps %+.1f mV\n", (eye.scale - 1) * width_ui * eom_ui_ps(data),
+			(eye.scale - 1) * 2 * half_mv);
+	}
+}
+
+/* One line of eye metrics per side, e.g. for screening on the target */
+static void eom_eye_summary(struct EOMData *data)
+{
+	struct eom_eye eye;
+	int slot, first, l;
+
+	for (slot = 0; slot < eom_nr_sides(); slot++) {
+		printf("Eye metrics%s:", both ? (slot ? " device" : " host") : "");
+		first = lane + slot * data->num_lanes;
+		for (l = first; l < first + data->num_lanes; l++) {
+			eom_eye_metrics(data, l, &eye);
+			printf("%s lane %d", l > first ? "," : "", eom_rx_lane(l));
+			if (!eye.open) {
+				printf(" closed");
+				continue;
+			}
+			printf(" width %.4f UI height %.1f mV center %+.4f UI mask %s scale %s%.2f",
+			       (eye.right - eye.left + 1) * eye.step_ui, (eye.high - eye.low + 1) * eye.step_mv,
+			       eye.center * eye.step_ui, eom_eye_mask_result(&eye), eye.limited ? ">=" : "", eye.scale);
+		}
+		printf("\n");
+	}
+}
+
+/* One sweep in the selected mode, all lanes are measured simultaneously at each point */
+static int eom_run_scan(int peer, bool *mask_failed)
+{
+	struct EOMData *data = &eom_data;
+	int t, v, l, ret = SUCCESS;
+
+	if (bathtub) {
+		ret = eom_bathtub_scan(peer);
+		if (ret) {
+			pr_err("Fail to run bathtub scan\n");
+			return ret;
+		}
+	} else if (mask) {
+		ret = eom_mask_scan(peer, mask_failed);
+		if (ret) {
+			pr_err("Fail to run eye mask test\n");
+			return ret;
+		}
+	} else if (seed_path[0] != '\0') {
+		ret = eom_delta_scan(peer);
+		if (ret) {
+			pr_err("Fail to run delta EOM scan\n");
+			return ret;
+		}
+	} else if (adaptive) {
+		for (l = lane; l < lane + data->num_lanes; l++) {
+			ret = eom_adaptive_scan(peer, l);
+			if (ret) {
+				pr_err("Fail to run adaptive EOM scan\n");
+				return ret;
+			}
+		}
+	} else {
+		for (t = timing_left; t <= timing_right; t++) {
+			for (v = voltage_low; v <= voltage_high; v++) {
+				/* Skip points off the planned stride, measured while planning or resumed */
+				if (t % scan_stride || v % scan_stride || eom_point_measured(data, t, v))
+					continue;
+
+				ret = eom_scan(peer, t, v, target_test_count, quick_target);
+				if (ret) {
+					pr_err("Fail to run EOM scan\n");
+					return ret;
+				}
+			}
+		}
+
+		if (scan_stride > 1)
+			eom_fill_stride();
+	}
+
+	if (quick_target) {
+		ret = eom_refine_boundary(peer);
+		if (ret) {
+			pr_err("Fail to re-measure EOM boundary\n");
+			return ret;
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Take over the points measured before a scan was interrupted. Only complete
+ * lines count and the report is cut after the last one, so that new points
+ * are appended right after it. A point listed twice was re-measured at a
+ * higher target test count, the last line wins. @append is left false if
+ * there is no report with a header to resume.
+ */
+static int eom_resume_report(const char *path, struct EOMData *data, bool *append)
+{
+	int l, t, v, e, target, n = 0;
+	struct eom_result *er;
+	char line[256], *p;
+	long valid = 0;
+	FILE *file;
+
+	file = fopen(path, "r");
+	if (!file) {
+		if (errno != ENOENT) {
+			pr_err("Failed to open EOM report %s to resume\n", path);
+			return ERROR;
+		}
+		printf("No EOM report %s to resume, starting a new scan\n", path);
+		return SUCCESS;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		if (!strchr(line, '\n'))
+			break;
+		valid = ftell(file);
+
+		if (eom_check_report_header(line, data, "Resumed"))
+			goto err;
+
+		if (strstr(line, "Side Eye Monitor Start"))
+			*append = true;
+
+		if (sscanf(line, "lane: %d timing: %d voltage: %d error count: %d", &l, &t, &v, &e) != 4)
+			continue;
+
+		/* Inferred and carried points are filled in again at the end of the scan */
+		if (strstr(line, eom_result_tag(EOM_RESULT_INFERRED)) || strstr(line, eom_result_tag(EOM_RESULT_CARRIED)))
+			continue;
+
+		if (l < lane || l >= lane + data->num_lanes || t < timing_left || t > timing_right ||
+		    v < voltage_low || v > voltage_high || e < 0)
+			continue;
+
+		p = strstr(line, "target:");
+		if (!p || sscanf(p, "target: %d", &target) != 1)
+			target = target_test_count;
+
+		er = eom_result_at(data, l, t, v);
+		if (!er->flags) {
+			data->data_cnt++;
+			n++;
+		}
+		er->lane = l;
+		er->timing = t;
+		er->volt = v;
+		er->error_cnt = e;
+		er->target_cnt = target;
+		er->flags = EOM_RESULT_MEASURED;
+	}
+
+	fclose(file);
+
+	if (!*append) {
+		printf("EOM report %s has no header, starting a new scan\n", path);
+		return SUCCESS;
+	}
+
+	if (truncate(path, valid)) {
+		pr_err("Failed to cut the incomplete line of EOM report %s\n", path);
+		return ERROR;
+	}
+
+	printf("Resumed EOM report %s: %d of %d points already measured\n", path, n, eom_result_count);
+
+	return SUCCESS;
+
+err:
+	fclose(file);
+	return ERROR;
+}
+
+/*
+ * Results the scan is going to record: the points on the planned stride, of the
+ * lanes kept by the planner, plus those measured off the stride while planning.
+ * Adaptive, mask and delta scans measure an unknown part of that grid.
+ */
+static int eom_progress_total(struct EOMData *data)
+{
+	int l, t, v, n = 0;
+
+	for (l = lane; l < lane + eom_nr_rx(); l++)
+		for (t = timing_left; t <= timing_right; t++)
+			for (v = voltage_low; v <= voltage_high; v++)
+				if ((!(t % scan_stride) && !(v % scan_stride)) ||
+				    (eom_result_at(data, l, t, v)->flags & EOM_RESULT_MEASURED))
+					n++;
+
+	return n;
+}
+
+/*
+ * Open the report the points are appended to as they are measured, along with
+ * its progress index "<report>.progress". A new report starts with the header
+ * and the points measured so far, e.g. while planning the scan.
+ */
+static int eom_stream_open(const char *path, struct EOMData *data, bool append, int slot)
+{
+	int i, per_side = eom_result_count / eom_nr_sides();
+	FILE *file;
+
+	if (snprintf(progress_file[slot], sizeof(progress_file[slot]), "%s.progress", path) >=
+	    (int)sizeof(progress_file[slot])) {
+		pr_err("EOM progress index path of %s is too long\n", path);
+		return ERROR;
+	}
+
+	file = fopen(path, append ? "a" : "w");
+	if (!file) {
+		pr_err("Failed to create EOM result file %s\n", path);
+		return ERROR;
+	}
+
+	progress_fd[slot] = open(progress_file[slot], O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+	if (progress_fd[slot] < 0) {
+		pr_err("Failed to create EOM progress index %s\n", progress_file[slot]);
+		fclose(file);
+		return ERROR;
+	}
+
+	stream_file[slot] = file;
+	stream_cnt[slot] = 0;
+	stream_start_ns = eom_now_ns();
+	progress_total = eom_progress_total(data);
+
+	if (!append) {
+		eom_report_header(file, data, eom_slot_side(slot));
+		for (i = slot * per_side; i < (slot + 1) * per_side; i++) {
+			if (data->er[i].flags & EOM_RESULT_MEASURED)
+				eom_report_point(file, &data->er[i]);
+		}
+	}
+
+	if (fflush(file) || fsync(fileno(file))) {
+		pr_err("Failed to write EOM report %s\n", path);
+		return ERROR;
+	}
+
+	return SUCCESS;
+}
+
+static void eom_stream_close(void)
+{
+	int slot;
+
+	for (slot = 0; slot < 2; slot++) {
+		if (!stream_file[slot])
+			continue;
+
+		fflush(stream_file[slot]);
+		fsync(fileno(stream_file[slot]));
+		fclose(stream_file[slot]);
+		stream_file[slot] = NULL;
+		close(progress_fd[slot]);
+	}
+}
+
+/*
+ * Replace the streamed report, which lists the points in the order they were
+ * measured, with the final one in grid order. It is written aside and renamed
+ * over the streamed report so that either of them is complete at any time.
+ */
+static int generate_eom_report(char *eom_file, struct EOMData *data, int slot)
+{
+	int i, per_side = eom_result_count / eom_nr_sides();
+	char tmp_report[1040];
+	FILE *file;
+
+	if (snprintf(tmp_report, sizeof(tmp_report), "%s.tmp", eom_file) >= (int)sizeof(tmp_report)) {
+		pr_err("Temporary path of EOM report %s is too long\n", eom_file);
+		return ERROR;
+	}
+
+	file = fopen(tmp_report, "w");
+	if (!file) {
+		pr_err("Failed to create EOM result file %s\n", tmp_report);
+		return ERROR;
+	}
+
+	eom_report_header(file, data, eom_slot_side(slot));
+
+	for (i = slot * per_side; i < (slot + 1) * per_side; i++) {
+		if (data->er[i].flags)
+			eom_report_point(file, &data->er[i]);
+	}
+
+	if (bathtub)
+		eom_bathtub_report(file, data);
+	if (eom_eye_valid(data))
+		eom_eye_report(file, data, slot);
+
+	if (repeat > 1)
+		eom_stats_report(file, data);
+
+	if (fflush(file) || fsync(fileno(file))) {
+		pr_err("Failed to write EOM result file %s\n", tmp_report);
+		fclose(file);
+		return ERROR;
+	}
+	fclose(file);
+
+	if (rename(tmp_report, eom_file)) {
+		pr_err("Failed to rename %s to %s\n", tmp_report, eom_file);
+		return ERROR;
+	}
+	unlink(progress_file[slot]);
+
+	printf("EOM results saved to %s\n", eom_file);
+
+	return SUCCESS;
+}
+
+/*
+ * The name fields of the binary header are NUL padded, not NUL terminated: a name as long as
+ * the field fills all of it, hdr is zeroed beforehand for the padding.
+ */
+static void eom_bin_name(char *field, size_t size, const char *name)
+{
+	size_t len = strlen(name);
+
+	memcpy(field, name, len < size ? len : size);
+}
+
+static int generate_eom_binary(char *eom_file, struct EOMData *data, int slot)
+{
+	int i, side = eom_slot_side(slot), per_side = eom_result_count / eom_nr_sides();
+	char bin_file[1040];
+	struct eom_bin_point *pt;
+	struct eom_bin_hdr hdr;
+	struct eom_bin bin;
+	struct eom_result *er;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.side = side == PEER;
+	hdr.gear = data->gear;
+	hdr.rate = data->rate;
+	hdr.flags = quick_target ? EOM_BIN_PER_POINT_TARGET : 0;
+	hdr.first_lane = lane;
+	hdr.nr_lanes = data->num_lanes;
+	hdr.target_cnt = target_test_count;
+	hdr.timing_left = timing_left;
+	hdr.timing_right = timing_right;
+	hdr.voltage_low = voltage_low;
+	hdr.voltage_high = voltage_high;
+	hdr.timing_max_steps = data->timing_max_steps;
+	hdr.timing_max_offset = eom_timing_max_offset(data, side);
+	hdr.voltage_max_steps = data->voltage_max_steps;
+	hdr.voltage_max_offset = eom_voltage_max_offset(data, side);
+	eom_bin_name(hdr.manufacturer, sizeof(hdr.manufacturer), dev_mname);
+	eom_bin_name(hdr.product, sizeof(hdr.product), dev_pname);
+	eom_bin_name(hdr.revision, sizeof(hdr.revision), dev_pver);
+
+	if (snprintf(bin_file, sizeof(bin_file), "%sb", eom_file) >= (int)sizeof(bin_file)) {
+		pr_err("Binary path of EOM report %s is too long\n", eom_file);
+		return ERROR;
+	}
+
+	if (eom_bin_create(&bin, bin_file, &hdr))
+		return ERROR;
+
+	for (i = slot * per_side; i < (slot + 1) * per_side; i++) {
+		er = &data->er[i];
+		if (!er->flags)
+			continue;
+
+		pt = eom_bin_point_at(&bin, eom_rx_lane(er->lane), er->timing, er->volt);
+		pt->error_cnt = er->error_cnt;
+		pt->tested_cnt = er->tested_cnt;
+		pt->target_cnt = er->target_cnt;
+		pt->flags = er->flags;
+	}
+
+	if (eom_bin_close(&bin))
+		return ERROR;
+
+	printf("EOM results saved to %s\n", bin_file);
+
+	return SUCCESS;
+}
+
+/* Convert a text report to binary, or a binary report (EOM_BIN_SUFFIX) to text */
+static int convert_eom_report(const char *path)
+{
+	size_t len = strlen(path), suffix = strlen(EOM_BIN_SUFFIX);
+	char out[1040];
+
+	if (len > suffix && !strcmp(path + len - suffix, EOM_BIN_SUFFIX)) {
+		snprintf(out, sizeof(out), "%.*s", (int)(len - 1), path);
+		return eom_bin_to_text(path, out);
+	}
+
+	if (len > suffix - 1 && !strcmp(path + len - suffix + 1, ".eom"))
+		snprintf(out, sizeof(out), "%sb", path);
+	else
+		snprintf(out, sizeof(out), "%s%s", path, EOM_BIN_SUFFIX);
+
+	return eom_bin_from_text(path, out);
+}
+
+static int check_output_path(const char *path)
+{
+	int i = 0, length = strlen(path);
+
+	for (; i < length; i++)
+		if (path[i] == ' ')
+			return ERROR;
+
+	if (path[length - 1] != '/')
+		return ERROR;
+
+	return SUCCESS;
+}
+
+/* Name of the bsg node of device @i, which also names its output folder */
+static const char *eom_device_name(int i)
+{
+	const char *name = strrchr(device_paths[i], '/');
+
+	return name ? name + 1 : device_paths[i];
+}
+
+static int init_device(void)
+{
+	if (nr_devices == EOM_MAX_DEVICES) {
+		pr_err("At most %d devices can be scanned at once\n", EOM_MAX_DEVICES);
+		return ERROR;
+	}
+
+	return init_device_path(device_paths[nr_devices++]);
+}
+
+static int init_lane(void)
+{
+	int l, ret;
+
+	ret = get_value_from_cli(&l);
+	if (ret) {
+		pr_err("Invalid input for Lane number\n");
+		return ERROR;
+	}
+
+	if (l < 0 || l > 1) {
+		pr_err("Invalid Lane number\n");
+		return ERROR;
+	}
+
+	lane = l;
+	eom_data.num_lanes = 1;
+
+	return SUCCESS;
+}
+
+static int init_target_test_count(int *count)
+{
+	int t, ret;
+
+	ret = get_value_from_cli(&t);
+	if (ret) {
+		pr_err("Invalid input for target test count\n");
+		return ERROR;
+	}
+
+	if (t <= 0 || t > EOM_TARGET_TEST_COUNT_MAX) {
+		pr_err("Invalid target test count\n");
+		return ERROR;
+	}
+
+	*count = t;
+
+	return SUCCESS;
+}
+
+static int parse_args(int argc, char *argv[])
+{
+	int i, j, c = 0, ret = ERROR;
+
+	if (argc < 2) {
+		pr_err("Too less args, try 'ufseom -h'\n");
 		return ret;
 	}
 
@@ -537,10 +4212,10 @@ static int parse_args(int argc, char *argv[])
 			ret = init_device_path(output_path);
 			break;
 		case 'd':
-			ret = init_device_path(device_path);
+			ret = init_device();
 			break;
 		case 't':
-			ret = init_target_test_count();
+			ret = init_target_test_count(&target_test_count);
 			break;
 		case 1:
 			ret = get_voltage_timing_value_from_cli(&voltage_low);
@@ -554,6 +4229,169 @@ static int parse_args(int argc, char *argv[])
 		case 4:
 			ret = get_voltage_timing_value_from_cli(&timing_right);
 			break;
+		case 5:
+			ret = init_positive_value(&cmd_rate, "command rate");
+			break;
+		case 6:
+			ret = init_positive_value(&cmd_burst, "command burst");
+			break;
+		case 7:
+			ret = init_device_path(qos_blk_devs);
+			break;
+		case 8:
+			ret = init_positive_value(&qos_latency, "latency target");
+			break;
+		case 9:
+			incremental = true;
+			ret = SUCCESS;
+			break;
+		case 10:
+			ret = init_positive_value(&validate_stride, "validation stride");
+			break;
+		case 11:
+			adaptive = true;
+			ret = SUCCESS;
+			break;
+		case 12:
+			ret = get_value_from_cli(&guard_band);
+			if (ret || guard_band < 0) {
+				pr_err("Invalid guard band\n");
+				ret = ERROR;
+			}
+			break;
+		case 13:
+			ret = init_device_path(seed_path);
+			break;
+		case 14:
+			mask = true;
+			ret = SUCCESS;
+			break;
+		case 15:
+			mask_margin = true;
+			ret = SUCCESS;
+			break;
+		case 16:
+			ret = init_target_test_count(&quick_target);
+			break;
+		case 17:
+			bathtub = true;
+			ret = SUCCESS;
+			break;
+		case 18:
+			ret = init_positive_value(&budget, "time budget");
+			break;
+		case 19:
+			dry_run = true;
+			ret = SUCCESS;
+			break;
+		case 20:
+			ret = get_value_from_cli(&fsync_points);
+			if (ret || fsync_points < 0) {
+				pr_err("Invalid fsync interval\n");
+				ret = ERROR;
+			}
+			break;
+		case 21:
+			resume = true;
+			ret = SUCCESS;
+			break;
+		case 22:
+			binary = true;
+			ret = SUCCESS;
+			break;
+		case 23:
+			ret = init_device_path(convert_path);
+			break;
+		case 24:
+			ret = init_positive_value(&repeat, "number of sweeps");
+			break;
+		case 25:
+			ret = init_positive_value(&interval, "sweep interval");
+			break;
+		case 26:
+			sweep_configs = true;
+			ret = SUCCESS;
+			break;
+		case 27:
+			both = true;
+			ret = SUCCESS;
+			break;
+		case 28:
+			ret = init_positive_value(&io_threads, "number of I/O threads");
+			if (!ret && io_threads > EOM_IO_THREADS_MAX) {
+				pr_err("At most %d I/O threads are supported\n", EOM_IO_THREADS_MAX);
+				ret = ERROR;
+			}
+			break;
+		case 29:
+			ret = get_value_from_cli(&poll_interval);
+			if (ret || poll_interval < 0) {
+				pr_err("Invalid poll interval\n");
+				ret = ERROR;
+			}
+			break;
+		case 30:
+			ret = SUCCESS;
+			if (!strcmp(optarg, "uring")) {
+				io_engine = EOM_IO_URING;
+			} else if (strcmp(optarg, "sync")) {
+				pr_err("Unknown I/O engine %s\n", optarg);
+				ret = ERROR;
+			}
+			break;
+		case 31:
+			ret = init_positive_value(&io_qd, "I/O queue depth");
+			if (!ret && io_qd > EOM_IO_QD_MAX) {
+				pr_err("I/O queue depth is at most %d\n", EOM_IO_QD_MAX);
+				ret = ERROR;
+			}
+			break;
+		case 32:
+			ret = init_positive_value(&io_bs, "I/O block size");
+			if (!ret && (io_bs % EOM_TEMP_DATA_MEM_ALIGN_SIZE || io_bs > EOM_TEMP_DATA_SIZE)) {
+				pr_err("I/O block size must be a multiple of %d up to %d\n", EOM_TEMP_DATA_MEM_ALIGN_SIZE,
+				       EOM_TEMP_DATA_SIZE);
+				ret = ERROR;
+			}
+			break;
+		case 33:
+			ret = get_value_from_cli(&io_write_pct);
+			if (ret || io_write_pct < 0 || io_write_pct > 100) {
+				pr_err("Invalid I/O write percentage\n");
+				ret = ERROR;
+			}
+			break;
+		case 34:
+			ret = init_device_path(io_target);
+			break;
+		case 35:
+			io_force = true;
+			ret = SUCCESS;
+			break;
+		case 36:
+			io_pattern = eom_pattern_parse(optarg);
+			if (io_pattern < 0) {
+				pr_err("Unknown data pattern %s\n", optarg);
+				ret = ERROR;
+			} else {
+				ret = SUCCESS;
+			}
+			break;
+		case 37:
+			ret = init_device_path(io_trace_path);
+			break;
+		case 38:
+			io_trace_afap = true;
+			ret = SUCCESS;
+			break;
+		case 39:
+			point_time = true;
+			ret = SUCCESS;
+			break;
+		case 40:
+			fixed_poll = true;
+			ret = SUCCESS;
+			break;
 
 		default:
 			pr_err("I cannot understand, please try 'ufseom -h'.\n");
@@ -561,45 +4399,199 @@ static int parse_args(int argc, char *argv[])
 			break;
 		}
 
-		if (ret)
-			break;
+		if (ret)
+			break;
+	}
+
+	if (ret)
+		return ret;
+
+	if (convert_path[0] != '\0')
+		return SUCCESS;
+
+	/* Local Rx first, the peer Rx follows as extra lanes */
+	if (both)
+		eom_data.local_peer = LOCAL;
+
+	if (eom_data.local_peer == INIT) {
+		pr_err("Local or peer is not given\n");
+		return ERROR;
+	}
+
+	if (lane == INIT) {
+		lane = 0;
+		eom_data.num_lanes = 2;
+		pr_err("Lane no. is not given, collect EOM data for all connected lanes\n");
+	}
+
+	if (target_test_count == INIT) {
+		target_test_count = EOM_TARGET_TEST_COUNT_DEFAULT;
+		pr_err("Target test count is not given, use default %d\n", target_test_count);
+	}
+
+	if (!nr_devices) {
+		pr_err("Path to bsg device not provided.\n");
+		return ERROR;
+	}
+	strcpy(device_path, device_paths[0]);
+
+	for (i = 1; i < nr_devices; i++) {
+		for (j = 0; j < i; j++) {
+			if (!strcmp(eom_device_name(i), eom_device_name(j))) {
+				pr_err("%s and %s would share an output folder\n", device_paths[j], device_paths[i]);
+				return ERROR;
+			}
+		}
+	}
+
+	/* A stress target is a LU or a file of one device */
+	if (nr_devices > 1 && io_target[0] != '\0') {
+		pr_err("--io-target cannot be combined with several -d, each device stresses its own output folder\n");
+		return ERROR;
+	}
+
+	if (output_path[0] == '\0') {
+		pr_err("Path to output folder not provided.\n");
+		return ERROR;
+	}
+
+	/* Check space and '/' in the given output path */
+	if (check_output_path(output_path)) {
+		pr_err("Invalid output path\n");
+		return ERROR;
+	}
+
+	if (validate_stride && !incremental) {
+		pr_err("--validate only applies to --incremental\n");
+		return ERROR;
+	}
+
+	if (guard_band && !adaptive && seed_path[0] == '\0') {
+		pr_err("--guard only applies to --adaptive or --seed\n");
+		return ERROR;
+	}
+
+	if (adaptive && seed_path[0] != '\0') {
+		pr_err("--adaptive and --seed cannot be combined\n");
+		return ERROR;
+	}
+
+	if (mask_margin && !mask) {
+		pr_err("--margin only applies to --mask\n");
+		return ERROR;
+	}
+
+	if (mask && (adaptive || seed_path[0] != '\0')) {
+		pr_err("--mask cannot be combined with --adaptive or --seed\n");
+		return ERROR;
+	}
+
+	if (bathtub && (mask || adaptive || seed_path[0] != '\0' || quick_target)) {
+		pr_err("--bathtub cannot be combined with --mask, --adaptive, --seed or --quick-target\n");
+		return ERROR;
+	}
+
+	if ((budget || dry_run) && (mask || adaptive || seed_path[0] != '\0' || quick_target || bathtub)) {
+		pr_err("--budget and --dry-run only apply to full grid scans\n");
+		return ERROR;
+	}
+
+	/* The plan may pick another target test count, and so another report */
+	if (resume && (budget || dry_run || bathtub)) {
+		pr_err("--resume cannot be combined with --budget, --dry-run or --bathtub\n");
+		return ERROR;
+	}
+
+	if (io_threads != EOM_IO_THREADS_DEFAULT && !do_io) {
+		pr_err("--io-threads only applies to -D\n");
+		return ERROR;
+	}
+
+	if (poll_interval == INIT)
+		poll_interval = do_io ? EOM_POLL_INTERVAL_DEFAULT : 0;
+
+	if ((io_engine != EOM_IO_SYNC || io_target[0] != '\0' || io_force || io_pattern != EOM_PATTERN_RANDOM) && !do_io) {
+		pr_err("--io-engine, --io-target, --io-force and --pattern only apply to -D\n");
+		return ERROR;
+	}
+
+	if (io_trace_afap && io_trace_path[0] == '\0') {
+		pr_err("--io-trace-afap only applies to --io-trace\n");
+		return ERROR;
+	}
+
+	if (io_trace_path[0] != '\0') {
+		if (io_engine != EOM_IO_URING) {
+			pr_err("--io-trace needs --io-engine uring\n");
+			return ERROR;
+		}
+		/* Sizes and reads/writes come from the trace */
+		if (io_bs != INIT || io_write_pct != INIT) {
+			pr_err("--io-bs and --io-write do not apply to --io-trace\n");
+			return ERROR;
+		}
+	}
+
+	if (io_engine == EOM_IO_URING) {
+		if (io_threads != EOM_IO_THREADS_DEFAULT) {
+			pr_err("--io-threads only applies to the sync engine, use --io-qd\n");
+			return ERROR;
+		}
+		if (io_write_pct == INIT)
+			io_write_pct = EOM_IO_WRITE_PCT_DEFAULT;
+	} else if (io_qd != INIT || io_bs != INIT || io_write_pct != INIT) {
+		pr_err("--io-qd, --io-bs and --io-write only apply to --io-engine uring\n");
+		return ERROR;
 	}
 
-	if (ret)
-		return ret;
+	if (interval && repeat < 2) {
+		pr_err("--interval only applies to --repeat\n");
+		return ERROR;
+	}
 
-	if (eom_data.local_peer == INIT) {
-		pr_err("Local or peer is not given\n");
+	/* Bathtub samples are kept for one sweep, resumed points for one sweep */
+	if (repeat > 1 && (bathtub || resume || dry_run)) {
+		pr_err("--repeat cannot be combined with --bathtub, --resume or --dry-run\n");
 		return ERROR;
 	}
 
-	if (lane == INIT) {
-		lane = 0;
-		eom_data.num_lanes = 2;
-		pr_err("Lane no. is not given, collect EOM data for all connected lanes\n");
+	/* Seeds, plans and bathtub samples are for one gear, resuming could mix up reports */
+	if (sweep_configs && (seed_path[0] != '\0' || budget || dry_run || bathtub || resume)) {
+		pr_err("--sweep cannot be combined with --seed, --budget, --dry-run, --bathtub or --resume\n");
+		return ERROR;
 	}
 
-	if (target_test_count == INIT) {
-		target_test_count = EOM_TARGET_TEST_COUNT_DEFAULT;
-		pr_err("Target test count is not given, use default %d\n", target_test_count);
+	/* Only the full grid visits the same points on both sides */
+	if (both && (adaptive || seed_path[0] != '\0' || mask || bathtub || budget || dry_run || repeat > 1 ||
+		     resume || sweep_configs)) {
+		pr_err("--both cannot be combined with --adaptive, --seed, --mask, --bathtub, --budget, --dry-run, --repeat, --resume or --sweep\n");
+		return ERROR;
 	}
 
-	if (device_path[0] == '\0') {
-		pr_err("Path to bsg device not provided.\n");
+	/* The mask outline is all boundary points, they would all be re-measured */
+	if (mask && quick_target) {
+		pr_err("--quick-target cannot be combined with --mask\n");
 		return ERROR;
 	}
 
-	if (output_path[0] == '\0') {
-		pr_err("Path to output folder not provided.\n");
+	if (quick_target >= target_test_count) {
+		pr_err("Quick target test count %d must be lower than the target test count %d\n",
+		       quick_target, target_test_count);
 		return ERROR;
 	}
 
-	/* Check space and '/' in the given output path */
-	if (check_output_path(output_path)) {
-		pr_err("Invalid output path\n");
+	/* The feedback would back off from the latency of the -D stress itself */
+	if (qos_blk_devs[0] != '\0' && do_io) {
+		pr_err("--qos-blk cannot be combined with -D\n");
 		return ERROR;
 	}
 
+	if (cmd_rate && throttle_init(cmd_rate, cmd_burst))
+		return ERROR;
+
+	if (qos_blk_devs[0] != '\0' && throttle_init_feedback(qos_blk_devs, qos_latency))
+		return ERROR;
+
 	return SUCCESS;
 }
 
@@ -664,22 +4656,321 @@ static void init_eom_operation(void)
 
 	output_path[0] = '\0';
 	device_path[0] = '\0';
+	qos_blk_devs[0] = '\0';
+	seed_path[0] = '\0';
+	convert_path[0] = '\0';
+	io_target[0] = '\0';
+	io_trace_path[0] = '\0';
 }
 
-int main(int argc, char *argv[])
+static int eom_disable(struct EOMData *data)
 {
-	struct EOMData *data = &eom_data;
+	int l, ret;
+
+	for (l = lane; l < lane + eom_nr_rx(); l++) {
+		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_ENABLE, SELECT_RX(eom_rx_lane(l))), ATTR_SET_NOR, 0,
+			      eom_rx_peer(data->local_peer, l));
+		if (ret) {
+			pr_err("Filed to disable EOM for lane %d\n", eom_rx_lane(l));
+			return ret;
+		}
+	}
+	data->eom_armed = false;
+
+	return SUCCESS;
+}
+
+/*
+ * Scan at the current gear and rate and save the report. @result, if given,
+ * gets the outcome for the --sweep summary.
+ */
+static int eom_run_config(struct EOMData *data, double predicted, bool *mask_failed,
+			  struct eom_config_result *result)
+{
+	char output_file[2][1024], eom_file_name[256], lane_str[8], rate_str[16] = "";
 	struct timespec ts_start, ts_end;
-	char tmp_file[1024], output_file[1024], eom_file_name[256], lane_str[8];
-	size_t eom_result_size;
-	int t, v, l, n, eom_cap, cur_gear, cur_rate, ret;
+	bool append = false;
+	int i, slot, sweep, ret;
 
-	init_eom_operation();
+	/*
+	 * EOM result file naming rule: local/peer_lane_0/_1_targetestcount.eom, plus the rate with --sweep.
+	 * --both saves a local and a peer report.
+	 */
+	snprintf(lane_str, sizeof(lane_str), "%d", lane);
+	if (sweep_configs)
+		snprintf(rate_str, sizeof(rate_str), "_rate_%c", data->rate == PA_HS_MODE_A ? 'A' : 'B');
+	for (slot = 0; slot < eom_nr_sides(); slot++) {
+		snprintf(eom_file_name, sizeof(eom_file_name), "%s_lane_%s_gear_%d%s_ttc_%d.eom",
+							      eom_slot_side(slot) ? "peer" : "local",
+							      (data->num_lanes == 2) ? "0_1" : lane_str,
+							      data->gear, rate_str, target_test_count);
+		strcpy(output_file[slot], output_path);
+		strcat(output_file[slot], eom_file_name);
+	}
 
-	ret = parse_args(argc, argv);
+	if (resume) {
+		ret = eom_resume_report(output_file[0], data, &append);
+		if (ret)
+			return ret;
+	}
+
+	for (slot = 0; slot < eom_nr_sides(); slot++) {
+		ret = eom_stream_open(output_file[slot], data, append, slot);
+		if (ret)
+			return ret;
+	}
+
+	printf("Start EOM Scan...\n");
+	eom_phase_reset();
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+	for (sweep = 1; sweep <= repeat; sweep++) {
+		if (sweep > 1) {
+			if (interval)
+				sleep(interval);
+			eom_reset_sweep(data);
+			printf("Sweep %d of %d...\n", sweep, repeat);
+		}
+
+		ret = eom_run_scan(data->local_peer, mask_failed);
+		if (ret)
+			return ret;
+
+		if (repeat > 1)
+			eom_stats_add(data);
+	}
+
+	/* Disable Eye Monitor */
+	ret = eom_disable(data);
 	if (ret)
 		return ret;
 
+	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+	printf("EOM Scan Finished!\n Time elapsed: %ld seconds\n", ts_end.tv_sec - ts_start.tv_sec);
+	if (budget)
+		printf("Scan plan predicted %.0f seconds\n", predicted);
+	if (incremental || verbose)
+		printf("PMCs: %d for %d points, %d incremental restarts fell back to PMC\n", data->pmc_cnt,
+		       data->data_cnt, data->pmc_fallback_cnt);
+	if (adaptive)
+		printf("Adaptive scan: %d points measured, %d inferred\n", data->data_cnt, data->inferred_cnt);
+	if (quick_target)
+		printf("Quick target test count %d: %d of %d points re-measured at %d\n", quick_target,
+		       data->recount_cnt, data->data_cnt / eom_nr_rx(), target_test_count);
+	throttle_stats();
+	eom_phase_report();
+	if (verbose && !fixed_poll)
+		eom_wait_report();
+
+	if (validate_stride) {
+		ret = eom_validate(data->local_peer, target_test_count);
+		if (ret)
+			return ret;
+
+		eom_disable(data);
+	}
+
+	if (repeat > 1)
+		eom_stats_apply(data);
+
+	if (result) {
+		result->seconds = ts_end.tv_sec - ts_start.tv_sec;
+		result->points = data->data_cnt;
+		for (i = 0; i < eom_result_count; i++) {
+			if (data->er[i].flags && !data->er[i].error_cnt)
+				result->open[data->er[i].lane - lane]++;
+		}
+	}
+
+	if (eom_eye_valid(data))
+		eom_eye_summary(data);
+
+	eom_stream_close();
+	for (slot = 0, ret = SUCCESS; slot < eom_nr_sides() && !ret; slot++) {
+		ret = generate_eom_report(output_file[slot], data, slot);
+		if (!ret && binary)
+			ret = generate_eom_binary(output_file[slot], data, slot);
+	}
+	if (ret)
+		pr_err("Filed to generate EOM report\n");
+
+	return ret;
+}
+
+static void eom_sweep_summary(FILE *file, struct eom_config_result *results, int nr_results)
+{
+	struct eom_config_result *r;
+	int i, l;
+
+	fprintf(file, "gear rate status seconds points");
+	for (l = lane; l < lane + eom_data.num_lanes; l++)
+		fprintf(file, " lane%d_open", l);
+	fprintf(file, "\n");
+
+	for (i = 0; i < nr_results; i++) {
+		r = &results[i];
+		fprintf(file, "HS-G%d %c %s %ld %d", r->gear, r->rate == PA_HS_MODE_A ? 'A' : 'B',
+			r->status ? "error" : r->mask_failed ? "mask-fail" : "ok", r->seconds, r->points);
+		for (l = 0; l < eom_data.num_lanes; l++)
+			fprintf(file, " %d", r->open[l]);
+		fprintf(file, "\n");
+	}
+}
+
+/*
+ * Scan at every HS gear from EOM_SUPPORTED_MIN_GEAR up to the highest one
+ * both sides support, in rate series A and B, with one report per gear and
+ * rate and a summary of all of them. The original gears, rate series, adapt
+ * type and power mode are restored at the end, even if a scan failed.
+ */
+static int eom_sweep_configs(struct EOMData *data, bool *mask_failed)
+{
+	struct eom_config_result results[EOM_SWEEP_MAX_CONFIGS];
+	int tx_gear, rx_gear, hs_series, adapt, pwr_mode, max_gear, peer_max_gear;
+	int gear, rate, nr_results = 0, ret = SUCCESS, restore;
+	char summary_file[1024], lane_str[8];
+	FILE *file;
+
+	tx_gear = uic_get(bsg_fd, UIC_ARG_MIB_SEL(PA_TXGEAR, SELECT_TX(0)), 0);
+	rx_gear = uic_get(bsg_fd, UIC_ARG_MIB_SEL(PA_RXGEAR, SELECT_TX(0)), 0);
+	hs_series = uic_get(bsg_fd, UIC_ARG_MIB_SEL(PA_HSSERIES, SELECT_TX(0)), 0);
+	adapt = uic_get(bsg_fd, UIC_ARG_MIB_SEL(PA_TXHSADAPTTYPE, SELECT_TX(0)), 0);
+	pwr_mode = uic_get(bsg_fd, UIC_ARG_MIB_SEL(PA_PWRMODE, SELECT_TX(0)), 0);
+	max_gear = uic_get(bsg_fd, UIC_ARG_MIB_SEL(PA_MAXRXHSGEAR, SELECT_TX(0)), 0);
+	peer_max_gear = uic_get(bsg_fd, UIC_ARG_MIB_SEL(PA_MAXRXHSGEAR, SELECT_TX(0)), PEER);
+	if (tx_gear < 0 || rx_gear < 0 || hs_series < 0 || adapt < 0 || pwr_mode < 0 || max_gear < 0 ||
+	    peer_max_gear < 0) {
+		pr_err("Failed to read the current power mode\n");
+		return ERROR;
+	}
+
+	if (peer_max_gear < max_gear)
+		max_gear = peer_max_gear;
+	if (max_gear > EOM_SWEEP_MAX_GEAR)
+		max_gear = EOM_SWEEP_MAX_GEAR;
+	if (max_gear < EOM_SUPPORTED_MIN_GEAR) {
+		pr_err("The link supports up to HS-G%d, EOM needs HS-G%d\n", max_gear, EOM_SUPPORTED_MIN_GEAR);
+		return ERROR;
+	}
+
+	printf("Sweeping HS-G%d to HS-G%d, Rate-A and Rate-B, currently HS-G%d Rate-%c\n", EOM_SUPPORTED_MIN_GEAR,
+	       max_gear, rx_gear, hs_series == PA_HS_MODE_A ? 'A' : 'B');
+
+	for (gear = EOM_SUPPORTED_MIN_GEAR; gear <= max_gear && !ret; gear++) {
+		for (rate = PA_HS_MODE_A; rate <= PA_HS_MODE_B && !ret; rate++) {
+			struct eom_config_result *r = &results[nr_results++];
+
+			memset(r, 0, sizeof(*r));
+			r->gear = gear;
+			r->rate = rate;
+			printf("\nHS-G%d Rate-%c:\n", gear, rate == PA_HS_MODE_A ? 'A' : 'B');
+
+			/* The link may not come up at this gear, stop sweeping and restore */
+			ret = eom_set_power_mode(gear, gear, rate, PA_NO_ADAPT, pwr_mode);
+			if (!ret && uic_get(bsg_fd, UIC_ARG_MIB_SEL(PA_RXGEAR, SELECT_TX(0)), 0) != gear) {
+				pr_err("The link did not change to HS-G%d\n", gear);
+				ret = ERROR;
+			}
+			if (ret) {
+				r->status = ret;
+				break;
+			}
+
+			data->gear = gear;
+			data->rate = rate;
+			eom_reset_sweep(data);
+			if (eom_stats)
+				memset(eom_stats, 0, eom_result_count * sizeof(struct eom_point_stats));
+
+			ret = eom_run_config(data, 0, &r->mask_failed, r);
+			r->status = ret;
+			if (r->mask_failed)
+				*mask_failed = true;
+		}
+	}
+
+	/* Eye Monitor may be left enabled by a failed scan */
+	eom_disable(data);
+
+	restore = eom_set_power_mode(tx_gear, rx_gear, hs_series, adapt, pwr_mode);
+	if (restore) {
+		pr_err("Failed to restore HS-G%d Rate-%c\n", rx_gear, hs_series == PA_HS_MODE_A ? 'A' : 'B');
+		ret = restore;
+	} else {
+		printf("\nRestored HS-G%d Rate-%c\n", rx_gear, hs_series == PA_HS_MODE_A ? 'A' : 'B');
+	}
+
+	printf("\nSweep summary:\n");
+	eom_sweep_summary(stdout, results, nr_results);
+
+	snprintf(lane_str, sizeof(lane_str), "%d", lane);
+	snprintf(summary_file, sizeof(summary_file), "%s%s_lane_%s_sweep_ttc_%d.txt", output_path,
+		 data->local_peer ? "peer" : "local", (data->num_lanes == 2) ? "0_1" : lane_str, target_test_count);
+	file = fopen(summary_file, "w");
+	if (!file) {
+		pr_err("Failed to create sweep summary %s\n", summary_file);
+		return ERROR;
+	}
+	fprintf(file, "UFS %s Side Eye Monitor Sweep\n", data->local_peer ? "Device" : "Host");
+	fprintf(file, "- - - - UFS INQUIRY ID: %s %s %s\n", dev_mname, dev_pname, dev_pver);
+	eom_sweep_summary(file, results, nr_results);
+	fclose(file);
+	printf("Sweep summary saved to %s\n", summary_file);
+
+	return ret;
+}
+
+/*
+ * --both scans the device Rx with the timing and voltage steps of the host
+ * Rx, only their offsets, i.e. the step sizes, may differ.
+ */
+static int eom_read_peer_caps(struct EOMData *data)
+{
+	int eom_cap, timing_max_steps, voltage_max_steps;
+
+	eom_cap = uic_get(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_CAPABILITY, SELECT_RX(lane)), PEER);
+	timing_max_steps = uic_get(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_TIMING_MAX_STEPS_CAPABILITY, SELECT_RX(lane)),
+				   PEER);
+	data->peer_timing_max_offset = uic_get(bsg_fd,
+					       UIC_ARG_MIB_SEL(RX_EYEMON_TIMING_MAX_OFFSET_CAPABILITY, SELECT_RX(lane)),
+					       PEER);
+	voltage_max_steps = uic_get(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_VOLTAGE_MAX_STEPS_CAPABILITY, SELECT_RX(lane)),
+				    PEER);
+	data->peer_voltage_max_offset = uic_get(bsg_fd,
+						UIC_ARG_MIB_SEL(RX_EYEMON_VOLTAGE_MAX_OFFSET_CAPABILITY, SELECT_RX(lane)),
+						PEER);
+	if (eom_cap < 0 || timing_max_steps < 0 || data->peer_timing_max_offset < 0 || voltage_max_steps < 0 ||
+	    data->peer_voltage_max_offset < 0) {
+		pr_err("Failed to get the EOM capabilities of the peer Rx\n");
+		return ERROR;
+	}
+
+	if (!(eom_cap & 0x1)) {
+		pr_err("EOM is not supported by the peer Rx\n");
+		return ERROR;
+	}
+
+	if (timing_max_steps != data->timing_max_steps || voltage_max_steps != data->voltage_max_steps) {
+		pr_err("Peer Rx max steps %d/%d differ from local Rx %d/%d, --both needs the same steps\n",
+		       timing_max_steps, voltage_max_steps, data->timing_max_steps, data->voltage_max_steps);
+		return ERROR;
+	}
+
+	if (verbose)
+		printf("Peer TimingMaxOffset %d VoltageMaxOffset %d\n", data->peer_timing_max_offset,
+		       data->peer_voltage_max_offset);
+
+	return SUCCESS;
+}
+
+/* Scan the device at device_path and save its reports in output_path */
+static int eom_scan_device(void)
+{
+	struct EOMData *data = &eom_data;
+	size_t eom_result_size;
+	int l, eom_cap, cur_gear, cur_rate, ret;
+	bool mask_failed = false;
+	double predicted = 0;
+
 	bsg_fd = open(device_path, O_RDWR);
 	if (bsg_fd < 0) {
 		pr_err("Filed to open file %s (%d).\n", device_path, bsg_fd);
@@ -708,7 +4999,8 @@ int main(int argc, char *argv[])
 		printf("PA_RxGear: %d\n", cur_gear);
 	}
 
-	if (cur_gear < EOM_SUPPORTED_MIN_GEAR) {
+	/* --sweep moves the link to supported gears by itself */
+	if (cur_gear < EOM_SUPPORTED_MIN_GEAR && !sweep_configs) {
 		pr_err("EOM is not supported at current gear %d\n", cur_gear);
 		ret = ERROR;
 		goto close_bsg;
@@ -731,33 +5023,35 @@ int main(int argc, char *argv[])
 	if (!do_io)
 		goto skip_io_prepare;
 
-	strcpy(tmp_file, output_path);
-	strcat(tmp_file, ufseom_tmp_file);
-	tmp_fd = open(tmp_file, O_RDWR | O_DIRECT | O_CREAT, S_IWUSR | S_IRUSR);
-	if (tmp_fd < 0) {
-		pr_err("Failed to open file %s (%d)\n", tmp_file, tmp_fd);
-		ret = ERROR;
-		goto close_bsg;
-	}
+	ret = eom_io_geometry();
+	if (ret)
+		goto close_tmp;
+
+	ret = eom_io_load_trace();
+	if (ret)
+		goto close_tmp;
+
+	ret = eom_io_open_target();
+	if (ret)
+		goto close_tmp;
 
 	/* Allocate buffer for I/O */
-	tmp_buf = memalign(EOM_TEMP_DATA_MEM_ALIGN_SIZE, EOM_TEMP_DATA_SIZE);
+	tmp_buf = memalign(EOM_TEMP_DATA_MEM_ALIGN_SIZE, eom_io_buf_size());
 	if (!tmp_buf) {
 		pr_err("Failed to allocate memory for I/O\n");
 		ret = ERROR;
 		goto close_tmp;
 	}
 
-skip_io_prepare:
-	/* EOM result file naming rule: local/peer_lane_0/_1_targetestcount.eom */
-	snprintf(lane_str, sizeof(lane_str), "%d", lane);
-	snprintf(eom_file_name, sizeof(eom_file_name), "%s_lane_%s_gear_%d_ttc_%d.eom",
-						      data->local_peer ? "peer" : "local",
-						      (data->num_lanes == 2) ? "0_1" : lane_str,
-						      cur_gear, target_test_count);
-	strcpy(output_file, output_path);
-	strcat(output_file, eom_file_name);
+	ret = eom_pattern_pool_init(&io_pool, io_pattern, EOM_TEMP_DATA_SIZE, EOM_IO_SEED);
+	if (ret)
+		goto out;
+
+	ret = eom_io_fill_target();
+	if (ret)
+		goto out;
 
+skip_io_prepare:
 	/* Get RX_EYEMON_Timing_MAX_Steps_Capability */
 	data->timing_max_steps = uic_get(bsg_fd,
 					 UIC_ARG_MIB_SEL(RX_EYEMON_TIMING_MAX_STEPS_CAPABILITY, SELECT_RX(lane)),
@@ -798,12 +5092,25 @@ skip_io_prepare:
 		goto out;
 	}
 
+	if (both) {
+		ret = eom_read_peer_caps(data);
+		if (ret)
+			goto out;
+	}
+
 	if (verbose) {
 		printf("EOM Capabilities:\n");
 		printf("TimingMaxSteps %d TimingMaxOffset %d\n", data->timing_max_steps, data->timing_max_offset);
 		printf("VoltageMaxSteps %d VoltageMaxOffset %d\n", data->voltage_max_steps, data->voltage_max_offset);
 	}
 
+	if ((mask || bathtub) && (!data->timing_max_offset || !data->voltage_max_offset ||
+				  !data->timing_max_steps || !data->voltage_max_steps)) {
+		pr_err("EOM max steps or offset capabilities are 0, cannot convert steps to UI and mV\n");
+		ret = ERROR;
+		goto out;
+	}
+
 	/* Sanity check for voltage and timing range*/
 	ret = timing_voltage_sanity_check(data);
 	if (ret) {
@@ -816,7 +5123,7 @@ skip_io_prepare:
 		printf("timing_left:%d, timing_right:%d, voltage_low:%d, voltage_high:%d\n",
 					timing_left, timing_right, voltage_low, voltage_high);
 
-	eom_result_count = (timing_right - timing_left + 1) * (voltage_high - voltage_low + 1) * data->num_lanes;
+	eom_result_count = (timing_right - timing_left + 1) * (voltage_high - voltage_low + 1) * eom_nr_rx();
 	eom_result_size = eom_result_count * sizeof(struct eom_result);
 	data->er = malloc(eom_result_size);
 	if (!data->er) {
@@ -826,45 +5133,227 @@ skip_io_prepare:
 	}
 	memset(data->er, 0, eom_result_size);
 
+	if (repeat > 1) {
+		eom_stats = calloc(eom_result_count, sizeof(struct eom_point_stats));
+		if (!eom_stats) {
+			pr_err("Failed to allocate memory for sweep statistics\n");
+			ret = ERROR;
+			goto out;
+		}
+	}
+
+	if (seed_path[0] != '\0') {
+		ret = load_seed_report(seed_path, data);
+		if (ret)
+			goto out;
+	}
+
 	/* Set seed for a new sequence of pseudo-random integers */
 	srand((unsigned)clock());
 
-	printf("Start EOM Scan...\n");
-	clock_gettime(CLOCK_MONOTONIC, &ts_start);
-	/* Main loop starts here */
-	for (l = lane, n = data->num_lanes; n > 0; n--, l++) {
-		for (t = timing_left; t <= timing_right; t++) {
-			for (v = voltage_low; v <= voltage_high; v++) {
-				ret = eom_scan(data->local_peer, l, t, v, target_test_count);
-				if (ret) {
-					pr_err("Fail to run EOM scan\n");
-					goto out;
-				}
-			}
-		}
+	ret = eom_io_start();
+	if (ret)
+		goto out;
 
-		/* Disable Eye Monitor */
-		ret = uic_set(bsg_fd, UIC_ARG_MIB_SEL(RX_EYEMON_ENABLE, SELECT_RX(l)), ATTR_SET_NOR, 0, data->local_peer);
+	if (budget || dry_run) {
+		ret = eom_plan_scan(data->local_peer, &predicted);
 		if (ret) {
-			pr_err("Filed to disable EOM for lane %d\n", l);
+			pr_err("Fail to plan EOM scan\n");
 			goto out;
 		}
-	}
 
-	clock_gettime(CLOCK_MONOTONIC, &ts_end);
-	printf("EOM Scan Finished!\n Time elapsed: %ld seconds\n", ts_end.tv_sec - ts_start.tv_sec);
+		if (dry_run) {
+			ret = eom_disable(data);
+			goto out;
+		}
+	}
 
-	ret = generate_eom_report(output_file, data);
+	ret = get_device_info(dev_mname, dev_pname, dev_pver);
 	if (ret)
-		pr_err("Filed to generate EOM report\n");
+		goto out;
+
+	if (sweep_configs)
+		ret = eom_sweep_configs(data, &mask_failed);
+	else
+		ret = eom_run_config(data, predicted, &mask_failed, NULL);
+	if (!ret && mask_failed)
+		ret = ERROR;
 
 out:
+	eom_io_stop();
+	eom_stream_close();
+	for (l = 0; l < EOM_MAX_LANES; l++) {
+		free(data->bathtub[l][0].samples);
+		free(data->bathtub[l][1].samples);
+	}
+	free(seed_err);
+	free(eom_stats);
 	free(data->er);
 	free(tmp_buf);
+	eom_pattern_pool_free(&io_pool);
 close_tmp:
+	eom_trace_free(&io_trace);
 	close(tmp_fd);
 close_bsg:
 	close(bsg_fd);
 
 	return ret;
 }
+
+/*
+ * Child process of device @i: scan it with the reports in @dir, and its
+ * output, which would otherwise interleave with the other devices', logged
+ * to @dir/ufseom.log.
+ */
+static int eom_device_child(int i, const char *dir)
+{
+	char log_file[DEVICE_PATH_NAME_SIZE_MAX + 16];
+	int fd;
+
+	snprintf(log_file, sizeof(log_file), "%s%s", dir, EOM_DEVICE_LOG);
+	fd = open(log_file, O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+	if (fd < 0) {
+		pr_err("Failed to create log %s (%d)\n", log_file, errno);
+		return ERROR;
+	}
+	dup2(fd, STDOUT_FILENO);
+	dup2(fd, STDERR_FILENO);
+	close(fd);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	strcpy(device_path, device_paths[i]);
+	strcpy(output_path, dir);
+
+	return eom_scan_device();
+}
+
+/* Print the progress index of each device still scanning */
+static void eom_devices_progress(pid_t *pids, char (*dirs)[DEVICE_PATH_NAME_SIZE_MAX])
+{
+	char path[2 * DEVICE_PATH_NAME_SIZE_MAX], line[64];
+	unsigned long long seconds;
+	int i, done, total;
+	struct dirent *de;
+	FILE *file;
+	DIR *dir;
+
+	for (i = 0; i < nr_devices; i++) {
+		if (!pids[i])
+			continue;
+
+		dir = opendir(dirs[i]);
+		if (!dir)
+			continue;
+
+		/* Both sides of --both progress together, one index is enough */
+		while ((de = readdir(dir))) {
+			if (!strstr(de->d_name, ".progress"))
+				continue;
+
+			if (snprintf(path, sizeof(path), "%s%s", dirs[i], de->d_name) >= (int)sizeof(path))
+				continue;
+
+			file = fopen(path, "r");
+			if (!file)
+				continue;
+			if (fgets(line, sizeof(line), file) &&
+			    sscanf(line, "%d of %d points %llu s", &done, &total, &seconds) == 3)
+				printf("%s: %d of %d points, %llu s\n", eom_device_name(i), done, total, seconds);
+			fclose(file);
+			break;
+		}
+		closedir(dir);
+	}
+}
+
+/*
+ * Scan every device given with -d concurrently, one process each, so that
+ * each device has its own copy of the scan state. The reports of a device
+ * are saved in a folder named after its bsg node in the output folder.
+ */
+static int eom_scan_devices(void)
+{
+	char dirs[EOM_MAX_DEVICES][DEVICE_PATH_NAME_SIZE_MAX];
+	struct timespec ts_start, ts_now;
+	pid_t pids[EOM_MAX_DEVICES];
+	int i, status, running = 0, failed = 0;
+	long elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+	memset(pids, 0, sizeof(pids));
+	for (i = 0; i < nr_devices; i++) {
+		if (snprintf(dirs[i], sizeof(dirs[i]), "%s%s/", output_path, eom_device_name(i)) >= (int)sizeof(dirs[i])) {
+			pr_err("Output path for %s is too long\n", device_paths[i]);
+			failed++;
+			continue;
+		}
+		if (mkdir(dirs[i], S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) && errno != EEXIST) {
+			pr_err("Failed to create output folder %s (%d)\n", dirs[i], errno);
+			failed++;
+			continue;
+		}
+
+		fflush(stdout);
+		fflush(stderr);
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			pr_err("Failed to start the scan of %s (%d)\n", device_paths[i], errno);
+			pids[i] = 0;
+			failed++;
+			continue;
+		}
+		if (!pids[i])
+			exit(eom_device_child(i, dirs[i]) ? EXIT_FAILURE : EXIT_SUCCESS);
+
+		printf("%s: scanning %s, log in %s%s\n", eom_device_name(i), device_paths[i], dirs[i], EOM_DEVICE_LOG);
+		running++;
+	}
+
+	while (running) {
+		sleep(1);
+		clock_gettime(CLOCK_MONOTONIC, &ts_now);
+		elapsed = ts_now.tv_sec - ts_start.tv_sec;
+
+		for (i = 0; i < nr_devices; i++) {
+			if (!pids[i] || waitpid(pids[i], &status, WNOHANG) != pids[i])
+				continue;
+
+			pids[i] = 0;
+			running--;
+			if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+				printf("%s: finished in %ld seconds\n", eom_device_name(i), elapsed);
+			} else {
+				printf("%s: failed after %ld seconds, see %s%s\n", eom_device_name(i), elapsed, dirs[i],
+				       EOM_DEVICE_LOG);
+				failed++;
+			}
+		}
+
+		if (running && !(elapsed % EOM_DEVICES_PROGRESS_INTERVAL))
+			eom_devices_progress(pids, dirs);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+	printf("Scanned %d devices in %ld seconds, %d failed\n", nr_devices, ts_now.tv_sec - ts_start.tv_sec, failed);
+
+	return failed ? ERROR : SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	init_eom_operation();
+
+	ret = parse_args(argc, argv);
+	if (ret)
+		return ret;
+
+	if (convert_path[0] != '\0')
+		return convert_eom_report(convert_path);
+
+	if (nr_devices > 1)
+		return eom_scan_devices();
+
+	return eom_scan_device();
+}
@@ -40,9 +40,12 @@
 #define RX_EYEMON_ERROR_COUNT			0x00FB
 #define RX_EYEMON_START				0x00FC
 
+#define PA_TXGEAR				0x1568
+#define PA_HSSERIES				0x156A
 #define PA_PWRMODE				0x1571
 #define PA_TXHSADAPTTYPE			0x15D4
 #define PA_RXGEAR				0x1583
+#define PA_MAXRXHSGEAR				0x1587
 #define RX_HSRATE_SERIES			0xA2
 
 #define RX_EYEMON_START_MASK			0x1